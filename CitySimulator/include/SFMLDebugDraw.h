@@ -19,6 +19,7 @@
 
 #include <Box2D/Box2D.h>
 #include <SFML/Window.hpp>
+#include <SFML/Graphics.hpp>
 #include "constants.hpp"
 
 namespace sf
@@ -31,10 +32,18 @@ namespace sfdd
 	const float SCALE = Constants::tileSizef;
 }
 
+/// Collects everything drawn into one line and one triangle batch, which
+/// are only drawn on Flush
 class SFMLDebugDraw : public b2Draw
 {
 private:
 	sf::RenderWindow *m_window;
+	sf::VertexArray m_lines;
+	sf::VertexArray m_triangles;
+
+	void AppendLine(const sf::Vector2f &p1, const sf::Vector2f &p2, const sf::Color &color);
+
+	void AppendCircle(const b2Vec2 &center, float32 radius, const sf::Color &color, bool solid);
 
 public:
 	SFMLDebugDraw(sf::RenderWindow &window);
@@ -70,6 +79,19 @@ public:
 
 	/// Draw a transform. Choose your own length scale.
 	void DrawTransform(const b2Transform &xf);
+
+	/// Draw an arrow from the given point, in pixels.
+	void DrawVector(const sf::Vector2f &from, const sf::Vector2f &vector, const sf::Color &color);
+
+	/// Draw the shapes of every fixture overlapping the given region, in metres.
+	void DrawFixtures(b2World &world, const b2AABB &region);
+
+	/// Draw everything collected since the last flush in two draw calls, and clear it.
+	void Flush();
+
+	std::size_t GetLineVertexCount() const;
+
+	std::size_t GetTriangleVertexCount() const;
 };
 
 #endif //SFMLDEBUGDRAW_H
@@ -8,22 +8,29 @@
 
 struct Animation
 {
-	typedef std::vector<sf::IntRect> Sequence;
-
-	explicit Animation(sf::Texture *animationTexture) : texture(animationTexture)
+	explicit Animation(sf::Texture *animationTexture) : texture(animationTexture), sequenceCount(0), frameCount(0)
 	{
 	}
 
+	/**
+	 * Adds a sequence, which must be the same length as any already added
+	 */
 	Animation *addRow(const sf::Vector2i &startPosition, const sf::Vector2i &spriteDimensions, int rowLength);
 
-
-	//	std::vector<Sequence>& getSequences()
-	//	{
-	//		return sequences;
-	//	}
+	/**
+	 * @return The texture rect of the given frame
+	 */
+	const sf::FloatRect &getFrame(std::size_t sequence, std::size_t frame) const
+	{
+		return frames[sequence * frameCount + frame];
+	}
 
 	sf::Texture *texture;
-	std::vector<Sequence> sequences;
+
+	// texture rects of every frame, sequence by sequence
+	std::vector<sf::FloatRect> frames;
+	std::size_t sequenceCount;
+	std::size_t frameCount; // per sequence
 };
 
 class Animator : public sf::Drawable
@@ -40,7 +47,12 @@ public:
 	void init(Animation *anim, float step, DirectionType initialDirection = DIRECTION_SOUTH,
 			  bool initiallyPlaying = false);
 
-	void tick(float delta);
+	/**
+	 * Advances the clock that every playing animator is derived from
+	 */
+	static void tickClock(float delta);
+
+	static float getClock();
 
 	/// <summary>
 	/// Turns in the given direction.
@@ -57,6 +69,13 @@ public:
 	/// </summary>
 	void togglePlaying(bool resetEachTime = false);
 
+	bool isPlaying() const;
+
+	/**
+	 * @return The current frame of the current sequence
+	 */
+	std::size_t getCurrentFrame() const;
+
 	void reset()
 	{
 		init(nullptr, 0);
@@ -64,25 +83,28 @@ public:
 
 	void draw(sf::RenderTarget &target, sf::RenderStates states) const override;
 
+	/**
+	 * Appends the current frame as a quad to the given batch
+	 * @param origin The top left corner, in pixels
+	 * @param scale The scale of the frame
+	 */
+	void appendQuad(sf::VertexArray &batch, const sf::Vector2f &origin, float scale) const;
+
+	const sf::Texture *getTexture() const;
+
 
 private:
 	Animation *animation;
 
-	Utils::TimeTicker ticker;
-
+	float step;
 	size_t currentSequence;
-	size_t currentFrame;
 	bool playing;
 
-	sf::VertexArray vertices;
-	sf::Vector2f currentSize;
+	// the frame when paused, or started from when playing
+	size_t startFrame;
+	float startTime;
 
 	DirectionType direction;
-
-
-	void resizeVertices(float width, float height);
-
-	void updateFrame();
 };
 
 #endif
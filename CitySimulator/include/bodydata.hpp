@@ -7,6 +7,16 @@
 struct Door;
 class Building;
 
+/**
+ * Fixture categories, so that contacts nobody cares about are never created
+ */
+enum CollisionCategory
+{
+	COLLISION_TERRAIN = 1 << 0,
+	COLLISION_DOOR = 1 << 1, // sensors
+	COLLISION_ENTITY = 1 << 2
+};
+
 enum BodyDataType
 {
 	BODYDATA_ENTITY,
@@ -66,6 +66,11 @@ public:
 
 	World *getInsideWorld() const;
 
+	/**
+	 * @return The bounds of the building in its outside world, in tiles
+	 */
+	const sf::IntRect &getBounds() const;
+
 private:
 	BuildingID id;
 	World *insideWorld;
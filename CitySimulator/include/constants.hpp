@@ -17,6 +17,8 @@ namespace Constants
 	extern const int tileSize;
 	extern const float tileSizef;
 	extern const int tilesetResolution;
+	extern const int chunkSize;
+	extern const int maxLightLevel;
 
 	extern const float scale;
 	extern const float tileScale;
@@ -45,6 +47,15 @@ namespace Direction
 	DirectionType random();
 
 	DirectionType fromAngle(double degrees);
+
+	/**
+	 * Classifies many vectors at once, as fromAngle would the angle of each,
+	 * by comparing components rather than with atan2. Four at a time with
+	 * SSE2 where available, which is always the case on x86-64
+	 * @param out Populated with count DirectionTypes
+	 */
+	void fromVectors(const float *x, const float *y, std::size_t count, unsigned char *out);
+
 	DirectionType parseString(const std::string &s);
 
 	void toVector(DirectionType direction, sf::Vector2f &out);
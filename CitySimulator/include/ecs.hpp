@@ -5,8 +5,11 @@
 #define CAMERA_ENTITY (-2)
 
 typedef int EntityID;
+typedef int AgentID;
 
 #include <boost/smart_ptr/shared_ptr.hpp>
+#include <functional>
+#include <unordered_map>
 #include <vector>
 #include <Box2D/Common/b2Math.h>
 #include <Box2D/Dynamics/b2Body.h>
@@ -15,6 +18,7 @@ typedef int EntityID;
 #include "constants.hpp"
 
 class b2World;
+class AgentGrid;
 
 
 // component-entity-systems
@@ -70,8 +74,18 @@ struct InputComponent : BaseComponent
 	boost::shared_ptr<Brain> brain;
 };
 
+enum MovementBackend
+{
+	MOVEMENT_BOX2D,
+	MOVEMENT_GRID
+};
+
 struct PhysicsComponent : BaseComponent
 {
+	PhysicsComponent() : body(nullptr), bWorld(nullptr), grid(nullptr), agent(-1)
+	{
+	}
+
 	void reset() override;
 
 	sf::Vector2f getTilePosition() const;
@@ -84,6 +98,8 @@ struct PhysicsComponent : BaseComponent
 
 	void setVelocity(const sf::Vector2f &velocity);
 
+	void setLinearDamping(float linearDamping);
+
 	bool isStopped();
 
 	bool isSteering();
@@ -92,10 +108,19 @@ struct PhysicsComponent : BaseComponent
 
 	float maxSpeed;
 	float damping;
+	bool entityCollision;
 
 	WorldID world;
+	MovementBackend backend;
+
+	// box2d backend
 	b2Body *body;
 	b2World *bWorld;
+
+	// grid backend
+	AgentGrid *grid;
+	AgentID agent;
+
 	b2Vec2 lastVelocity;
 
 	b2Vec2 steering;
@@ -115,9 +140,9 @@ public:
 	{
 	}
 
-	void tick(EntityService *es, float dt);
+	virtual void tick(EntityService *es, float dt);
 
-	void render(EntityService *es, WorldID currentWorld, sf::RenderWindow &window);
+	virtual void render(EntityService *es, WorldID currentWorld, sf::RenderWindow &window);
 
 	virtual void tickEntity(EntityService *es, EntityID e, float dt) = 0;
 
@@ -130,6 +155,33 @@ protected:
 	int mask;
 };
 
+/**
+ * Entities in draw order, by depth, kept sorted incrementally between frames
+ */
+class DepthOrder
+{
+public:
+	/**
+	 * Keeps the entities still present in their last order, drops the rest, appends
+	 * any new ones, then restores the order with an insertion sort. This is cheap
+	 * when few entities have changed depth since the last update
+	 * @param entities The entities to order, which may contain duplicates
+	 * @param getDepth Returns the depth of an entity, where deeper entities are drawn later
+	 * @return The number of places entities were shifted by the sort
+	 */
+	int update(const std::vector<EntityID> &entities, const std::function<float(EntityID)> &getDepth);
+
+	const std::vector<EntityID> &getOrder() const;
+
+private:
+	std::vector<EntityID> order;
+	std::vector<float> depths;
+
+	// the last update each entity was seen in, indexed by entity
+	std::vector<int> seen;
+	int updates = 0;
+};
+
 class RenderSystem : public System
 {
 public:
@@ -137,9 +189,81 @@ public:
 	{
 	}
 
+	/**
+	 * Gathers the movement of every animated entity into packed arrays,
+	 * decides all of their playing states and facings from those, then
+	 * applies the packed results to each animator in turn
+	 */
+	void tick(EntityService *es, float dt) override;
+
+	/**
+	 * Updates the animation of a single entity
+	 */
 	void tickEntity(EntityService *es, EntityID e, float dt) override;
 
+	/**
+	 * Draws every entity in view in the given world with one draw call per texture,
+	 * or as coloured points in a single draw call when zoomed far out
+	 */
+	void render(EntityService *es, WorldID currentWorld, sf::RenderWindow &window) override;
+
 	void renderEntity(EntityService *es, EntityID e, WorldID currentWorld, sf::RenderWindow &window) override;
+
+	/**
+	 * @return The number of draw calls made by the last render, excluding debug rendering
+	 */
+	int getLastDrawCalls() const;
+
+	/**
+	 * Sets the region to draw entities in during the next render
+	 * @param tiles The region, in tiles
+	 */
+	void setVisibleTiles(const sf::FloatRect &tiles);
+
+	/**
+	 * @return The number of entities considered by the last render
+	 */
+	int getLastVisibleCount() const;
+
+	/**
+	 * @return The entities drawn by the last render, in the order they were drawn
+	 */
+	const std::vector<EntityID> &getDrawOrder() const;
+
+private:
+	// quads of every entity using each texture, reused between frames
+	std::unordered_map<const sf::Texture *, sf::VertexArray> batches;
+	int lastDrawCalls = 0;
+
+	sf::FloatRect visibleTiles;
+	std::vector<EntityID> visible; // reused between frames
+	DepthOrder drawOrder;
+	sf::VertexArray points;
+
+	// velocity vectors, when debug rendering physics
+	bool renderVelocities = false;
+	sf::VertexArray debugLines;
+
+	void renderPoints(EntityService *es, float pointSize, sf::RenderWindow &window);
+
+	// animation state of the entities queued this tick, packed
+	std::vector<EntityID> animated;
+	std::vector<float> velocityX, velocityY;
+	std::vector<float> lastVelocityX, lastVelocityY;
+	std::vector<unsigned char> steering;
+	std::vector<unsigned char> playing;
+	std::vector<unsigned char> directions;
+
+	/**
+	 * Adds the movement of the given entity to the packed arrays, unless
+	 * its animation is stopped and it is asleep
+	 */
+	void queueAnimation(EntityService *es, EntityID e);
+
+	/**
+	 * Decides and applies the animation of every queued entity
+	 */
+	void animateQueued(EntityService *es);
 };
 
 class InputSystem : public System
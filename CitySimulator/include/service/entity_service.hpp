@@ -1,6 +1,8 @@
 #ifndef CITYSIMULATOR_ENTITY_SERVICE_HPP
 #define CITYSIMULATOR_ENTITY_SERVICE_HPP
 
+#include <bitset>
+#include <deque>
 #include "base_service.hpp"
 #include "ecs.hpp"
 #include "world.hpp"
@@ -19,18 +21,65 @@ public:
 
 	EntityID createEntity();
 
-	EntityIdentifier *createEntity(EntityType type);
+	/**
+	 * @param prototype The name of the loaded entity it is created as, so
+	 * it is only recycled as the same again
+	 */
+	EntityIdentifier *createEntity(EntityType type, const std::string &prototype = "");
 
 	void killEntity(EntityID e);
 
+	/**
+	 * Kills the given entity, but keeps its components warm and parks its
+	 * deactivated body in its world, to be handed out again by the next
+	 * recycleEntity of the same type and prototype
+	 */
+	void despawnEntity(EntityID e);
+
+	/**
+	 * Revives the most recently despawned entity of the given type and prototype,
+	 * with the components it had when despawned and the entity collision of the
+	 * prototype. Its body is reused from the given world's parked bodies if possible,
+	 * otherwise created. Anything set per spawn, such as speed, animation and
+	 * direction, is left for the caller to set again
+	 * @param world The world to spawn in, only needed if it has a physics component
+	 * @param startTilePos The position to spawn at, in tiles
+	 * @return The revived entity, or null if none of the type and prototype are despawned
+	 */
+	EntityIdentifier *recycleEntity(EntityType type, const std::string &prototype, World *world,
+	                                const sf::Vector2i &startTilePos);
+
+	/**
+	 * @return The name of the loaded entity the given entity was created as, if any
+	 */
+	const std::string &getPrototype(EntityID e) const;
+
+	/**
+	 * @return The fraction of recycleEntity calls that revived an entity
+	 */
+	float getRecycleHitRate() const;
+
 	bool isAlive(EntityID e) const;
 
 	EntityID getComponentMask(EntityID e) const;
 
+	/**
+	 * Asleep entities are stationary and not steering, so the physics and
+	 * render systems skip them until steering or a push wakes them
+	 */
+	bool isAsleep(EntityID e) const;
+
+	void setAsleep(EntityID e, bool asleep);
+
+	unsigned int getAsleepCount() const;
+
 	// systems
 	void tickSystems(float delta);
 
-	void renderSystems(WorldID currentWorld);
+	/**
+	 * @param visibleTiles The region of the world in view, in tiles
+	 */
+	void renderSystems(WorldID currentWorld, const sf::FloatRect &visibleTiles);
 
 	// component management
 	void removeComponent(EntityID e, ComponentType type);
@@ -45,8 +94,28 @@ public:
 		return dynamic_cast<T *>(getComponentOfType(e, type));
 	}
 
+	/**
+	 * @param entityCollision If false, the entity walks through other entities
+	 */
 	void addPhysicsComponent(EntityIdentifier &entity, World *world, const sf::Vector2i &startTilePos,
-							 float maxSpeed, float damping);
+							 float maxSpeed, float damping, bool entityCollision = true);
+
+	/**
+	 * Adds the entity's body or agent to the given loaded world, reusing
+	 * a parked body if there is one
+	 * @param pos The position, in tiles
+	 */
+	void placeInWorld(EntityID e, World *world, const sf::Vector2f &pos);
+
+	/**
+	 * Takes the entity's body or agent out of its world, parking its body there for reuse
+	 */
+	void removeFromWorld(EntityID e);
+
+	/**
+	 * @return The "entity-collision" tag of the given entity prototype, true by default
+	 */
+	bool collidesWithEntities(EntityType type, const std::string &name) const;
 
 	void addRenderComponent(const EntityIdentifier &entity, const std::string &animation, float step,
 							DirectionType initialDirection, bool playing);
@@ -56,7 +125,8 @@ public:
 	void addAIInputComponent(EntityID e);
 
 	/**
-	 * @return A new body with new BodyData for the given entity
+	 * @return A new body for the given entity, sharing the entity's BodyData.
+	 * Collides with other entities according to its physics component
 	 */
 	b2Body *createBody(b2World *world, EntityIdentifier &entity, const sf::Vector2f &pos);
 
@@ -73,8 +143,25 @@ public:
 private:
 	EntityID entities[MAX_ENTITIES];
 	EntityIdentifier identifiers[MAX_ENTITIES];
+	std::string prototypes[MAX_ENTITIES]; // kept out of the identifiers, as they are held in unions
 
 	EntityID entityCount;
+	std::bitset<MAX_ENTITIES> asleep;
+
+	// recycling
+	EntityID recycledMasks[MAX_ENTITIES]; // components of despawned entities, held until recycled
+	unsigned long despawnOrder[MAX_ENTITIES];
+	unsigned long despawnCount;
+	std::map<std::pair<EntityType, std::string>, std::deque<EntityID>> recycledEntities; // oldest first
+	int recycleHits;
+	int recycleMisses;
+
+	/**
+	 * Frees the slot of the entity despawned longest ago for a new one,
+	 * which is at the front of one of the recycled queues
+	 * @return The freed entity, or MAX_ENTITIES if none are despawned
+	 */
+	EntityID reclaimRecycledEntity();
 
 	// loading
 	std::map<EntityType, EntityTags> loadedTags;
@@ -86,12 +173,17 @@ private:
 	RenderComponent renderComponents[MAX_ENTITIES];
 	InputComponent inputComponents[MAX_ENTITIES];
 
+	// reused by every body of the entity, in any world
+	BodyData bodyData[MAX_ENTITIES];
+
 	// systems
 	std::vector<System *> systems;
 	RenderSystem *renderSystem;
 
 	// helpers
 	BaseComponent *addComponent(EntityID e, ComponentType type);
+
+	b2Filter getEntityFilter(EntityID e) const;
 };
 
 #endif
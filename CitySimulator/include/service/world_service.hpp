@@ -1,11 +1,13 @@
 #ifndef CITYSIMULATOR_WORLD_SERVICE_HPP
 #define CITYSIMULATOR_WORLD_SERVICE_HPP
 
+#include <future>
 #include "base_service.hpp"
 #include "world.hpp"
 #include "building.hpp"
 #include "bodydata.hpp"
 #include "events.hpp"
+#include "worker_pool.hpp"
 
 class WorldService : public BaseService
 {
@@ -18,8 +20,46 @@ public:
 
 	World *getMainWorld();
 
+	/**
+	 * @return The world with the given ID, which may not be loaded, 
+	 * or null if there is no such world
+	 */
 	World *getWorld(WorldID id);
 
+	/**
+	 * Loads the per-instance state of the given world if it is not
+	 * already, such as when an entity enters it or intends to. 
+	 * Empty worlds are unloaded again after an idle timeout
+	 * @return The loaded world. Throws an exception if there is no such world
+	 */
+	World *instantiateWorld(WorldID id);
+
+	/**
+	 * Starts creating the per-instance state of the given world on a
+	 * worker thread, if it is not already loaded or being prefetched.
+	 * The world is loaded on a later tick, or when next instantiated
+	 */
+	void prefetchWorld(WorldID id);
+
+	/**
+	 * Remeshes the terrain collision of the given region of a world, and 
+	 * rebuilds the affected chunks of every loaded world sharing its terrain
+	 * @param id The world that was changed
+	 * @param tiles The changed region, in tiles
+	 * @return The total cost of the rebuild
+	 */
+	CollisionRebuildCost rebuildRegion(WorldID id, const sf::IntRect &tiles);
+
+	/**
+	 * Applies all tile changes of the given edit, then notifies every
+	 * terrain edit listener of the changed region of each affected chunk
+	 */
+	void commitTerrainEdit(const TerrainEdit &edit);
+
+	void registerTerrainListener(TerrainEditListener *listener);
+
+	void unregisterTerrainListener(TerrainEditListener *listener);
+
 	/**
 	  * Gets the location paired with the given source location
 	  * @return If true, the destination is stored in our, 
@@ -35,6 +75,12 @@ public:
 
 	void tickActiveWorlds(float delta);
 
+	/**
+	 * @return The light of outside worlds at the current time of day, from
+	 * the configured night light at midnight to 1 at noon
+	 */
+	float getAmbientLight() const;
+
 private:
 
 	struct ConnectionDetails
@@ -54,7 +100,20 @@ private:
 	Tileset tileset;
 	std::string mainWorldName;
 
+	/**
+	 * Adds the animated tiles listed in the config to the tileset, if any
+	 */
+	void loadTileAnimations();
+
+	/**
+	 * Makes the light sources listed in the config emit light
+	 */
+	void loadLightEmitters();
+
+	float timeOfDay; // seconds since noon
+
 	std::map<WorldID, World *> worlds;
+	std::map<WorldID, float> activeWorlds; // idle time of instantiated worlds
 	std::unordered_map<std::string, WorldTerrain> terrainCache;
 	WorldConnectionTable connectionLookup;
 	std::unordered_map<Location, ConnectionDetails> doorDetails;
@@ -68,6 +127,127 @@ private:
 		void onEvent(const Event &event) override;
 	} entityTransferListener;
 
+	struct PendingTransfer
+	{
+		Event event;
+		WorldID from;
+
+		PendingTransfer(const Event &event, WorldID from) : event(event), from(from)
+		{ }
+	};
+
+	// queued by door contacts, carried out at the end of the tick
+	std::vector<PendingTransfer> pendingTransfers;
+
+	WorkerPool workers; // shared by world steps, prefetches and terrains, so thread use is bounded
+
+	/**
+	 * Steps the physics of the given worlds, concurrently if enabled.
+	 * Box2D's global profiling counters, such as b2_gjkCalls and b2_toiCalls,
+	 * are incremented by every step without synchronisation, so they are
+	 * meaningless while stepping concurrently. Nothing here reads them
+	 */
+	void stepWorlds(const std::vector<World *> &stepping, float delta);
+
+	/**
+	 * Moves every entity queued to switch worlds this tick, grouped by world pair
+	 */
+	void processTransfers();
+
+	void transferEntity(const Event &event, World *newWorld);
+
+	std::vector<TerrainEditListener *> terrainListeners;
+
+	struct TerrainRenderListener : TerrainEditListener
+	{
+		void onTerrainEdit(World *world, const sf::IntRect &region) override;
+	} terrainRenderListener;
+
+	struct TerrainCollisionListener : TerrainEditListener
+	{
+		WorldService *ws;
+
+		TerrainCollisionListener(WorldService *ws);
+
+		void onTerrainEdit(World *world, const sf::IntRect &region) override;
+	} terrainCollisionListener;
+
+	struct BuildingIndexListener : TerrainEditListener
+	{
+		void onTerrainEdit(World *world, const sf::IntRect &region) override;
+	} buildingIndexListener;
+
+	/**
+	 * Watches entities approaching doors, and prefetches the worlds
+	 * on the other side before they are entered
+	 */
+	struct WorldPrefetcher
+	{
+		typedef std::pair<Location, Location> DoorConnection;
+		typedef std::unordered_map<long long, std::vector<DoorConnection>> DoorCells; // by cell key
+
+		/**
+		 * A collision map being created on a worker thread
+		 */
+		struct PendingPrefetch
+		{
+			unsigned long editGeneration; // of the terrain when started
+			std::future<CollisionMap *> map;
+		};
+
+		WorldService *ws;
+		std::map<WorldID, PendingPrefetch> pending;
+		std::unordered_map<WorldID, DoorCells> doors; // by source world
+
+		WorldPrefetcher(WorldService *ws);
+
+		/**
+		 * Groups all door connections by their source world, and then by
+		 * the cell they are in, so only nearby doors are checked
+		 */
+		void discoverDoors(const WorldConnectionTable &connections);
+
+		/**
+		 * Loads any finished prefetches, then starts prefetching
+		 * the destinations of doors that entities are approaching
+		 */
+		void tick();
+
+		void prefetch(WorldID id);
+
+		/**
+		 * Waits for a pending prefetch of the given world to finish
+		 * @return The prefetched collision map, or null if there was none
+		 * or its terrain has been edited since it was started
+		 */
+		CollisionMap *take(WorldID id);
+
+		/**
+		 * Waits for and discards all pending prefetches
+		 */
+		void cancelAll();
+
+		/**
+		 * Waits for and discards the pending prefetches of every world using
+		 * the given terrain, so that it can be edited safely
+		 */
+		void cancelTerrain(const WorldTerrain *terrain);
+
+	private:
+		void watchEntity(PhysicsComponent *phys, float radius);
+
+		/**
+		 * Waits for the given prefetch to finish
+		 * @return The prefetched collision map, or null if it is out of date and so was deleted
+		 */
+		CollisionMap *finish(WorldID id, PendingPrefetch &prefetch);
+
+		/**
+		 * @return The key of the door cell containing the given tile
+		 */
+		static long long getCellKey(int tileX, int tileY);
+	} prefetcher;
+
 	struct WorldLoader
 	{
 		enum DoorTag
@@ -0,0 +1,71 @@
+#ifndef CITYSIMULATOR_WORKER_POOL_HPP
+#define CITYSIMULATOR_WORKER_POOL_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * A fixed set of worker threads that run queued jobs, so that threads
+ * are not created and joined every frame. The threads are only started
+ * when the first job is submitted
+ */
+class WorkerPool
+{
+public:
+	/**
+	 * @param workerCount The number of threads, or 0 for one per hardware thread
+	 */
+	explicit WorkerPool(std::size_t workerCount = 0);
+
+	/**
+	 * Finishes the queued jobs, then joins the threads
+	 */
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool &) = delete;
+
+	WorkerPool &operator=(const WorkerPool &) = delete;
+
+	/**
+	 * Queues a job to be run by the next idle worker
+	 * @return Ready once the job has run, holding its result or any exception it threw
+	 */
+	template<class Job>
+	std::future<typename std::result_of<Job()>::type> submit(Job job)
+	{
+		typedef typename std::result_of<Job()>::type Result;
+
+		// shared, as queued jobs must be copyable
+		auto task = std::make_shared<std::packaged_task<Result()>>(std::move(job));
+		std::future<Result> result = task->get_future();
+		enqueue([task]()
+		{
+			(*task)();
+		});
+		return result;
+	}
+
+	std::size_t getWorkerCount() const;
+
+private:
+	std::size_t workerCount;
+	std::vector<std::thread> workers;
+
+	std::mutex mutex;
+	std::condition_variable jobAdded;
+	std::deque<std::function<void()>> jobs;
+	bool stopping;
+
+	void enqueue(std::function<void()> job);
+
+	void work();
+};
+
+#endif
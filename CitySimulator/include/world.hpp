@@ -5,12 +5,18 @@
 #include <Box2D/Box2D.h>
 #include <unordered_map>
 #include <set>
+#include <memory>
+#include <deque>
+#include <list>
+#include <future>
 #include <boost/optional.hpp>
 #include <bits/unordered_set.h>
 #include "building.hpp"
 #include "SFMLDebugDraw.h"
 #include "maploader.hpp"
+#include "ecs.hpp"
 #include "bodydata.hpp"
+#include "worker_pool.hpp"
 
 class World;
 struct BodyData;
@@ -75,6 +81,16 @@ bool isTileLayer(LayerType layerType);
 
 bool isOverLayer(LayerType layerType);
 
+/**
+ * A block type drawn as a looping sequence of other tiles of the tileset
+ */
+struct TileAnimation
+{
+	BlockType blockType;
+	std::vector<int> frames; // tileset indices
+	float frameDuration; // seconds
+};
+
 /**
  * The tileset for the world
  */
@@ -85,7 +101,10 @@ public:
 
 	void load();
 
-	void textureQuad(sf::Vertex *quad, const BlockType &blockType, int rotationAngle, int flipGID);
+	/**
+	 * Only reads the tileset, so may be called from several threads at once
+	 */
+	void textureQuad(sf::Vertex *quad, const BlockType &blockType, int rotationAngle, int flipGID) const;
 
 	sf::Texture *getTexture() const;
 
@@ -97,6 +116,50 @@ public:
 
 	sf::IntRect getTileRect(unsigned blockType);
 
+	/**
+	 * @return The average colour of the opaque pixels of the given block
+	 * type, for drawing it as a single pixel when zoomed far out
+	 */
+	sf::Color getAverageColour(unsigned blockType) const;
+
+	/**
+	 * Animates every tile of the given block type. Must be called before
+	 * converting to a texture, so that flipped tiles are placed after the frames
+	 * @param frames The tileset index of each frame
+	 * @param frameDuration The duration of each frame, in seconds
+	 */
+	void addAnimation(BlockType blockType, const std::vector<int> &frames, float frameDuration);
+
+	/**
+	 * @return The index of the animation of the given block type, or -1 if it is not animated
+	 */
+	int getAnimationIndex(unsigned blockType) const;
+
+	std::size_t getAnimationCount() const;
+
+	/**
+	 * @return The tileset index of the frame of the given animation at the given time
+	 */
+	int getAnimationFrame(int animation, float time) const;
+
+	/**
+	 * @return The flip GID of the given animation frame, flipped as the tile
+	 * with the given flip GID is
+	 */
+	static int getFrameFlipGID(int flipGID, int frame);
+
+	/**
+	 * Makes every tile and object of the given block type a light source
+	 * @param intensity The light level of the source's own tile, which falls
+	 * by one per tile away from it
+	 */
+	void setLightEmission(BlockType blockType, int intensity);
+
+	/**
+	 * @return The light level emitted by the given block type, or 0 if it is not a light source
+	 */
+	int getLightEmission(unsigned blockType) const;
+
 private:
 	sf::Image *image;
 	sf::Texture texture;
@@ -106,6 +169,12 @@ private:
 
 	std::unordered_map<int, int> flippedBlockTypes;
 	bool converted;
+	std::vector<sf::Color> averageColours; // per block type
+
+	std::vector<TileAnimation> animations;
+	std::vector<int> animationIndices; // per block type, -1 if not animated
+
+	std::vector<unsigned char> lightEmissions; // per block type
 
 	void addPoint(int x, int y);
 
@@ -138,9 +207,60 @@ struct WorldObject
 	BlockType type;
 	float rotation;
 	sf::Vector2f tilePos;
+	int flipGID;
+
+	WorldObject(BlockType blockType, float rotationAngle, const sf::Vector2f &position, int flipGID = 0) :
+			type(blockType), rotation(rotationAngle), tilePos(position), flipGID(flipGID)
+	{
+	}
+};
+
+/**
+ * The compact per-layer state of a single tile, from which
+ * render chunks are generated on demand
+ */
+struct TileData
+{
+	int flipGID;
+	short rotation;
+	unsigned char blockType;
+
+	TileData() : flipGID(0), rotation(0), blockType(BLOCK_BLANK)
+	{
+	}
+};
+
+/**
+ * The vertices of a square region of terrain, built from
+ * tile data when it comes into view
+ */
+struct TerrainChunk
+{
+	sf::VertexArray tileVertices;
+	sf::VertexArray overLayerVertices;
+	sf::VertexArray objectVertices;
+	std::list<int>::iterator usage; // position in the least recently used list
 
-	WorldObject(BlockType blockType, float rotationAngle, const sf::Vector2f &position) :
-			type(blockType), rotation(rotationAngle), tilePos(position)
+	/**
+	 * A quad of an animated tile
+	 */
+	struct AnimatedQuad
+	{
+		unsigned int vertex;
+		short rotation;
+		int flipGID;
+		bool overLayer;
+	};
+
+	// indexed by tileset animation, so each animation only
+	// touches the tiles it animates
+	std::vector<std::vector<AnimatedQuad>> animatedQuads;
+	std::vector<int> animatedFrames; // tileset index of each animation's current frame
+
+	int ambientStep; // ambient light the vertices were last coloured with
+	bool lightStale; // light levels changed since then
+
+	TerrainChunk() : ambientStep(-1), lightStale(true)
 	{
 	}
 };
@@ -159,7 +279,212 @@ struct WorldLayer
 };
 
 /**
- * A world item that holds static world collision boxes
+ * A static collision box, merged from adjacent collidable tiles
+ */
+struct CollisionRect
+{
+	sf::FloatRect rect;
+	float rotation;
+	BlockType blockType;
+
+	CollisionRect(const sf::FloatRect &r, float rot, BlockType blockType = BLOCK_UNKNOWN)
+			: rect(r), rotation(rot), blockType(blockType)
+	{
+	}
+};
+
+/**
+ * The cost of rebuilding the static collision of part of a world
+ */
+struct CollisionRebuildCost
+{
+	int chunks;
+	int fixturesRemoved;
+	int fixturesAdded;
+	float milliseconds;
+
+	CollisionRebuildCost() : chunks(0), fixturesRemoved(0), fixturesAdded(0), milliseconds(0.f)
+	{
+	}
+};
+
+/**
+ * A single tile change in a terrain edit
+ */
+struct TileEdit
+{
+	sf::Vector2i tile;
+	BlockType blockType;
+	LayerType layer;
+	int rotationAngle;
+	int flipGID;
+};
+
+/**
+ * A batch of tile changes to a world, which are committed together
+ * through the world service
+ */
+class TerrainEdit
+{
+public:
+	explicit TerrainEdit(WorldID world);
+
+	TerrainEdit &setBlockType(const sf::Vector2i &tile, BlockType blockType, 
+			LayerType layer = LAYER_TERRAIN, int rotationAngle = 0, int flipGID = 0);
+
+	WorldID getWorld() const;
+
+	const std::vector<TileEdit> &getEdits() const;
+
+	bool isEmpty() const;
+
+private:
+	WorldID world;
+	std::vector<TileEdit> edits;
+};
+
+/**
+ * Notified after a terrain edit is committed, to rebuild whatever
+ * it derives from the tiles in the changed region
+ */
+struct TerrainEditListener
+{
+	/**
+	 * @param world The edited world
+	 * @param region The changed tiles, which are all within a single chunk
+	 */
+	virtual void onTerrainEdit(World *world, const sf::IntRect &region) = 0;
+
+	std::string identifier = "anonymous terrain edit listener";
+};
+
+/**
+ * The corners of a closed loop around a region of solid tiles, in tiles
+ */
+typedef std::vector<sf::Vector2f> CollisionOutline;
+
+/**
+ * Hands out BodyData from fixed-size blocks, reusing released entries.
+ * Everything is freed along with the pool
+ */
+class BodyDataPool
+{
+public:
+	BodyDataPool();
+
+	~BodyDataPool();
+
+	BodyData *acquire();
+
+	void release(BodyData *data);
+
+	/**
+	 * @return The number of entries acquired and not yet released
+	 */
+	int getInUseCount() const;
+
+	/**
+	 * @return The number of entries allocated, in use or not
+	 */
+	int getCapacity() const;
+
+private:
+	std::vector<BodyData *> blocks;
+	std::vector<BodyData *> freeList;
+	int inUse;
+};
+
+/**
+ * A lightweight alternative to Box2D for moving entities. Agents collide
+ * directly with the terrain's block grid, and with each other through a
+ * uniform spatial hash. Agents are kept in parallel arrays, so that
+ * integrating them all is a tight loop over contiguous floats
+ */
+class AgentGrid : public BaseWorld
+{
+public:
+	explicit AgentGrid(World *container);
+
+	/**
+	 * @param pos The position of the entity, in tiles
+	 * @param entityCollision If false, the agent passes through other agents
+	 */
+	AgentID addAgent(EntityID entity, const sf::Vector2f &pos, bool entityCollision);
+
+	void removeAgent(AgentID agent);
+
+	sf::Vector2f getPosition(AgentID agent) const;
+
+	sf::Vector2f getVelocity(AgentID agent) const;
+
+	void setVelocity(AgentID agent, const sf::Vector2f &velocity);
+
+	void setDamping(AgentID agent, float damping);
+
+	/**
+	 * @return The radius of the circle at the agent's feet that collides, in tiles
+	 */
+	float getRadius() const;
+
+	int getAgentCount() const;
+
+	/**
+	 * Updates the cached solid and door tiles in the given region, if
+	 * they have been cached yet
+	 */
+	void refreshTiles(const sf::IntRect &tiles);
+
+	/**
+	 * Moves every agent, then pushes them out of each other and solid tiles
+	 * @param enteredDoors Populated with every agent that stepped onto a door tile, and the tile
+	 */
+	void step(float delta, std::vector<std::pair<EntityID, sf::Vector2i>> &enteredDoors);
+
+	/**
+	 * Finds every agent positioned inside the given region
+	 * @param tiles The region, in tiles
+	 * @param out Populated with the entities of the agents
+	 */
+	void queryRegion(const sf::FloatRect &tiles, std::vector<EntityID> &out) const;
+
+private:
+	// per agent, indexed densely
+	std::vector<float> posX, posY;
+	std::vector<float> velX, velY;
+	std::vector<float> damping;
+	std::vector<unsigned char> entityCollision;
+	std::vector<EntityID> entities;
+	std::vector<sf::Vector2i> lastTiles;
+
+	// stable handles to dense indices
+	std::vector<int> indices; // -1 if free
+	std::vector<AgentID> handles;
+	std::vector<AgentID> freeHandles;
+
+	// spatial hash of one tile cells, rebuilt every step
+	std::vector<int> bucketHeads;
+	std::vector<int> nextInBucket;
+	bool hashed = false; // false if agents were added or removed since
+
+	// solid and door flags of every tile, cached when the first agent is added
+	std::vector<unsigned char> tileFlags;
+
+	int getIndex(AgentID agent) const;
+
+	int getBucket(int cellX, int cellY) const;
+
+	void cacheTiles();
+
+	void hashAgents();
+
+	void separateAgents();
+
+	void collideWithTiles(int index);
+};
+
+/**
+ * A world item that holds static world collision boxes.
+ * Every world instance has its own, even if its terrain is shared
  */
 class CollisionMap : public BaseWorld
 {
@@ -168,64 +493,219 @@ public:
 
 	~CollisionMap();
 
+	/**
+	 * Creates collision fixtures and finishes loading immediately
+	 */
 	void load();
 
+	/**
+	 * Creates collision fixtures from the merged collision
+	 * rects of the container's terrain. This only reads shared
+	 * world state, so is safe to call from a worker thread
+	 */
+	void createFixtures();
+
+	/**
+	 * Reports problems found by createFixtures and sets up debug
+	 * rendering. Must be called on the main thread
+	 */
+	void finishLoading();
+
+	/**
+	 * Loads the chunks around every dynamic body, and unloads any that
+	 * have not been near one for a while. Does nothing if the terrain
+	 * is not streamed, as every chunk is then always loaded
+	 */
+	void streamChunks(float delta);
+
+	/**
+	 * Replaces the fixtures of the loaded chunks overlapping the given region
+	 * with the terrain's current collision rects, which must already have
+	 * been remeshed. Must not be called during a physics step
+	 * @param tiles The changed region, in tiles
+	 * @return The cost of the rebuild
+	 */
+	CollisionRebuildCost rebuildRegion(const sf::IntRect &tiles);
+
+	/**
+	 * @return True if the static body of the given chunk is loaded
+	 */
+	bool isChunkLoaded(int chunk) const;
+
+	/**
+	 * @return The number of static terrain bodies currently loaded
+	 */
+	int getStaticBodyCount() const;
+
+	/**
+	 * @return The number of fixtures on all loaded static terrain bodies
+	 */
+	int getStaticFixtureCount() const;
+
+	/**
+	 * @return The number of broadphase proxies of all loaded static 
+	 * terrain bodies, which is one per box or one per outline edge
+	 */
+	int getStaticProxyCount() const;
+
+	/**
+	 * @return The agents moved by the grid movement backend
+	 */
+	AgentGrid *getAgentGrid();
+
+	/**
+	 * Steps the grid agents, and queues their door contacts
+	 */
+	void stepAgents(float delta);
+
+	/**
+	 * Finds every entity in this world positioned inside the given
+	 * region, whether moved by box2d or the agent grid
+	 * @param tiles The region, in tiles
+	 * @param out Populated with the entities, in no particular order
+	 */
+	void queryEntities(const sf::FloatRect &tiles, std::vector<EntityID> &out);
+
+	/**
+	 * Raises a world switch event for every door an entity touched during
+	 * the last step. Must be called on the main thread
+	 */
+	void dispatchDoorContacts();
+
+	/**
+	 * Deactivates an entity body that has left this world, and keeps it
+	 * to be reused by the next entity to enter. Destroys it instead if
+	 * enough are already parked
+	 */
+	void parkEntityBody(b2Body *body);
+
+	/**
+	 * Reactivates a parked entity body for an entity entering this world
+	 * @param data The BodyData of the entering entity
+	 * @param filter The collision filter of the entering entity
+	 * @param pos The new position, in tiles
+	 * @return The body, or null if none are parked
+	 */
+	b2Body *unparkEntityBody(BodyData *data, const b2Filter &filter, const sf::Vector2f &pos);
+
+	/**
+	 * @return The number of inactive entity bodies kept for reuse
+	 */
+	int getParkedBodyCount() const;
+
+	/**
+	 * @return The pool of the BodyData attached to static fixtures
+	 */
+	const BodyDataPool &getBodyDataPool() const;
+
+	/**
+	 * Draws the fixtures in the given region, if debug rendering is enabled
+	 * @param visibleTiles The region, in tiles
+	 */
+	void renderDebug(const sf::FloatRect &visibleTiles);
+
 protected:
+	BodyDataPool bodyDataPool; // outlives the world
 	b2World world;
-	b2Body *worldBody;
+	std::vector<b2Body *> chunkBodies; // null if not loaded
+	std::vector<float> chunkIdleTimes;
+	int staticBodyCount;
+	std::vector<b2Body *> parkedBodies;
+	AgentGrid agents;
 	
 	friend class World;
 
 private:
+	/**
+	 * Queues door contacts, as it may be called on a worker thread
+	 */
 	struct GlobalContactListener : public b2ContactListener
 	{
+		CollisionMap *map;
+
+		GlobalContactListener(CollisionMap *map) : map(map)
+		{
+		}
+
 		virtual void BeginContact(b2Contact *contact) override;
 	};
 
+	struct DoorContact
+	{
+		Location door;
+		EntityID entity;
+
+		DoorContact(const Location &door, EntityID entity) : door(door), entity(entity)
+		{
+		}
+	};
+
 	GlobalContactListener globalContactListener;
 
-	struct CollisionRect
+	/**
+	 * Returns block BodyData to the pool whenever a body is destroyed
+	 */
+	struct FixtureDestructionListener : public b2DestructionListener
 	{
-		sf::FloatRect rect;
-		float rotation;
-		BlockType blockType;
+		BodyDataPool *pool;
+
+		FixtureDestructionListener(BodyDataPool *pool) : pool(pool)
+		{
+		}
 
-		CollisionRect(const sf::FloatRect &r, float rot, BlockType blockType = BLOCK_UNKNOWN)
-				: rect(r), rotation(rot), blockType(blockType)
+		virtual void SayGoodbye(b2Joint *) override
 		{
 		}
+
+		virtual void SayGoodbye(b2Fixture *fixture) override;
 	};
 
+	FixtureDestructionListener fixtureDestructionListener;
+
 	boost::optional<SFMLDebugDraw> b2Renderer;
 
-	void mergeRectangles(std::vector<CollisionRect> &src, std::vector<CollisionRect> &dst,
-	                     bool (*pred)(const CollisionRect &));
+	// collected by createFixtures, logged by finishLoading
+	std::vector<sf::Vector2i> missingDoors;
+	int doorCount;
 
-	void findCollidableTiles(std::vector<CollisionRect> &rects) const;
+	// raised during the last step, dispatched by dispatchDoorContacts
+	std::vector<DoorContact> doorContacts;
 
-	void mergeAdjacentTiles(std::vector<CollisionRect> &rects);
+	BodyData *createBodyData(BlockType blockType, const sf::Vector2i &tilePos);
 
-	static bool compareRectsHorizontally(const CollisionRect &acr, const CollisionRect &bcr);
-	static bool compareRectsVertically(const CollisionRect &acr, const CollisionRect &bcr);
+	void loadChunk(int chunk);
 
-	static bool distanceChecker(const CollisionRect *last, const CollisionRect *current);
-	static bool dimensionChecker(const CollisionRect *last, const CollisionRect *current);
-	static bool interactivityChecker(const CollisionRect *last, const CollisionRect *current);
+	void unloadChunk(int chunk);
 
-	void mergeHelper(std::vector<CollisionRect> &rects,
-	                 bool (*nextRowFunc)(const CollisionRect *last, const CollisionRect *current));
+	/**
+	 * @return The region covered by the given collision rect once rotated, in tiles
+	 */
+	static sf::FloatRect getTileBounds(const CollisionRect &collisionRect);
 
-	BodyData *createBodyData(BlockType blockType, const sf::Vector2i &tilePos);
+	/**
+	 * @return The tile that the door covering the given tile is keyed by,
+	 * or the tile itself if no door covers it
+	 */
+	sf::Vector2i getDoorTile(const sf::Vector2i &tile) const;
+
+	void logMissingDoors();
 };
 
 
 /**
- * A world item that holds the block type of every tile in the world
+ * A world item that holds the block type of every tile in the world.
+ * This is shared between all worlds with the same name, and so must
+ * not hold any per-instance state
  */
-class WorldTerrain : public BaseWorld
+class WorldTerrain
 {
 public:
-	WorldTerrain(World *container, const sf::Vector2i &size);
+	WorldTerrain(const sf::Vector2i &size);
+
+	/**
+	 * Waits for the chunks still being built by workers
+	 */
+	~WorldTerrain();
 
 	void setBlockType(const sf::Vector2i &pos, BlockType blockType, 
 			LayerType layer = LAYER_TERRAIN, int rotationAngle = 0, int flipGID = 0);
@@ -247,55 +727,315 @@ public:
 	 */
 	void loadFromTileMap(TMX::TileMap &tmx, std::unordered_set<int> &flippedGIDs);
 
-	void applyTiles(Tileset &tileset);
+	/**
+	 * Places the loaded tiles and objects, and fully builds small terrains
+	 * @param workers Shared with the world service, to build chunks on
+	 */
+	void applyTiles(Tileset &tileset, WorkerPool &workers);
 
+	/**
+	 * Finds and merges all collidable tiles per chunk, to be shared 
+	 * between the collision maps of all worlds using this terrain
+	 */
 	void loadBlockData();
 
+	/**
+	 * @return The merged collision rects of the tiles in the given chunk, in pixels
+	 */
+	const std::vector<CollisionRect> &getCollisionRects(int chunk) const;
+
+	/**
+	 * @return The collision rects of the objects in the given chunk, in pixels
+	 */
+	const std::vector<CollisionRect> &getObjectCollisionRects(int chunk) const;
+
+	/**
+	 * @return The outlines around the solid, non-interactable tiles of the given chunk
+	 */
+	const std::vector<CollisionOutline> &getCollisionOutlines(int chunk) const;
+
+	/**
+	 * Sets the tiles of a terrain edit, without rebuilding anything derived
+	 * from them. Throws an exception before changing anything if any tile 
+	 * is invalid
+	 * @param dirtyRegions Populated with the changed region of every affected chunk
+	 */
+	void applyEdits(const std::vector<TileEdit> &edits, std::vector<sf::IntRect> &dirtyRegions);
+
+	/**
+	 * Rebuilds the vertices of the built render chunks overlapping the given region
+	 */
+	void rebuildRenderRegion(const sf::IntRect &tiles);
+
+	/**
+	 * Remeshes the collision rects and outlines of the chunks overlapping
+	 * the given region, after its tiles have changed
+	 * @param tiles The changed region, in tiles
+	 */
+	void remeshRegion(const sf::IntRect &tiles);
+
+	/**
+	 * @return A counter that changes whenever the collision rects are remeshed, so
+	 * that state derived from them on another thread can tell it is out of date
+	 */
+	unsigned long getEditGeneration() const;
+
+	/**
+	 * @param tiles A region, in tiles
+	 * @param out The chunks overlapping the region, which is clamped to the world
+	 */
+	void getChunksInRegion(const sf::IntRect &tiles, std::vector<int> &out) const;
+
+	/**
+	 * @return True if collision maps should use outline loops for solid
+	 * tiles instead of their merged rects
+	 */
+	bool usesCollisionOutlines() const;
+
+	sf::Vector2i getSize() const;
+
+	/**
+	 * @return The number of chunks in each dimension
+	 */
+	sf::Vector2i getChunkCount() const;
+
+	/**
+	 * @return The index of the chunk containing the given tile, which is clamped to the world
+	 */
+	int getChunkIndex(const sf::Vector2i &tile) const;
+
+	/**
+	 * @return The tiles covered by the given chunk
+	 */
+	sf::IntRect getChunkBounds(int chunk) const;
+
+	/**
+	 * @return True if this terrain is too large to keep fully loaded, and so 
+	 * its render and collision chunks are streamed in and out as needed
+	 */
+	bool isStreamed() const;
+
+	/**
+	 * Adopts the render chunks built by workers since the last call, hands
+	 * the missing chunks in and around the given region to workers within
+	 * the per-frame load limit, and evicts the least recently used chunks
+	 * when over the memory budget. Never waits for a worker
+	 * @param visibleTiles The visible region, in tiles
+	 */
+	void streamChunks(const sf::FloatRect &visibleTiles);
+
+	/**
+	 * @return The number of render chunks currently built
+	 */
+	std::size_t getResidentChunkCount() const;
+
+	/**
+	 * Builds (or rebuilds) the vertices of the given render chunks, split
+	 * between worker threads as each chunk is independent of the others,
+	 * and waits for them to finish
+	 * @param indices The chunks to build, which may contain duplicates
+	 */
+	void buildChunks(const std::vector<int> &indices);
+
+	/**
+	 * Re-textures the animated tiles of the built chunks in the given region
+	 * whose animation has changed frame since they were last drawn
+	 * @param time The animation clock, in seconds
+	 * @param visibleTiles The visible region, in tiles
+	 */
+	void animateTiles(float time, const sf::FloatRect &visibleTiles);
+
+	/**
+	 * Draws the given region in a single call, from the level of the overview
+	 * pyramid closest to one pixel per texel
+	 * @param visibleTiles The visible region, in tiles
+	 */
+	void renderOverview(sf::RenderTarget &target, sf::RenderStates &states, const sf::FloatRect &visibleTiles) const;
+
+	/**
+	 * Rebakes the given region of every level of the overview pyramid. The
+	 * finest level has one pixel per tile, coloured by the topmost tile that
+	 * is not blank, and each following level has half the resolution
+	 * @param tiles The region, in tiles
+	 */
+	void bakeOverview(const sf::IntRect &tiles);
+
+	/**
+	 * @return The given level of the overview pyramid, with 2^level tiles per pixel
+	 */
+	const sf::Image &getOverview(std::size_t level) const;
+
+	/**
+	 * @return The number of levels in the overview pyramid
+	 */
+	std::size_t getOverviewLevelCount() const;
+
+	/**
+	 * Rereads the light sources among the tiles and objects of the given
+	 * region, queueing the region to have its light spread again if any changed
+	 */
+	void refreshLightSources(const sf::IntRect &tiles);
+
+	/**
+	 * Collects the light spread by workers since the last call, hands newly
+	 * changed regions to workers, and recolours a limited number of the built
+	 * chunks whose light has changed, visible chunks first
+	 * @param ambient The light of tiles without any light sources nearby, from 0 to 1
+	 * @param visibleTiles The visible region, in tiles
+	 */
+	void updateLighting(float ambient, const sf::FloatRect &visibleTiles);
+
+	/**
+	 * @return The light level of the given tile as last spread, from 0 to Constants::maxLightLevel
+	 */
+	int getLightLevel(const sf::Vector2i &tile) const;
+
+	/**
+	 * @return True if no light is waiting to be spread, or being spread
+	 */
+	bool isLightSettled() const;
+
 
 private:
 	Tileset *tileset;
 	TMX::TileMap *tmx;
-	CollisionMap collisionMap;
+	WorkerPool *workers; // null until applied
 
-	sf::VertexArray tileVertices;
-	sf::VertexArray overLayerVertices;
-
-	std::vector<BlockType> blockTypes;
+	std::vector<TileData> tiles;
 	std::vector<WorldObject> objects;
 	std::map<LayerType, int> layerDepths;
 
+	sf::Vector2i chunkCount;
+	bool streamed;
+	std::unordered_map<int, TerrainChunk> chunks;
+	std::list<int> chunkUsage; // built chunks, most recently used first
+	std::vector<sf::Image> overviewImages; // finest first, kept to rebake edited regions
+	std::vector<sf::Texture> overviewTextures; // empty if too large for the graphics card
+	std::vector<std::vector<std::size_t>> chunkObjects; // object indices per chunk
+	std::vector<std::vector<CollisionRect>> chunkCollisionRects;
+	std::vector<std::vector<CollisionRect>> chunkObjectRects;
+	std::vector<std::vector<CollisionOutline>> chunkCollisionOutlines;
+	bool collisionOutlines;
+	unsigned long editGeneration;
+
+	// index among tile layers, and among the under/over layers it is drawn with
+	std::map<LayerType, std::pair<int, int>> tileLayerIndices;
+
 	int tileLayerCount;
 	int overLayerCount;
 
+	/**
+	 * A region whose light is being spread by a worker
+	 */
+	struct LightJob
+	{
+		sf::IntRect region;
+		std::future<std::vector<unsigned char>> levels;
+	};
+
+	/**
+	 * A streamed chunk being built by a worker
+	 */
+	struct ChunkJob
+	{
+		int chunk;
+		std::future<TerrainChunk> built;
+	};
+
+	std::deque<ChunkJob> chunkJobs; // adopted by streamChunks once finished
+
+	std::vector<unsigned char> lightSources; // per tile, the brightest source on it
+	std::vector<unsigned char> lightLevels; // per tile
+	std::deque<sf::IntRect> dirtyLight; // waiting for a worker, at most one per chunk
+	std::deque<LightJob> lightJobs; // collected in order, so newer light always wins
+	int ambientStep;
+
+	static const int ambientSteps = 32; // so slowly changing ambient light rarely recolours
+
+	/**
+	 * Spreads the given light sources in place, so that every tile is at least
+	 * as bright as each source less its distance from it in tiles
+	 */
+	static void spreadLight(std::vector<unsigned char> &levels, int width, int height);
+
+	/**
+	 * Colours the vertices of the given chunk by the light of their tiles and the
+	 * current ambient light. Only reads the light levels, so may be called for
+	 * different chunks from several threads at once
+	 */
+	void colourChunk(int chunk, TerrainChunk &out) const;
+
 	void discoverLayers(std::vector<TMX::Layer> &tmxLayers);
 
 	void discoverFlippedTiles(const std::vector<TMX::Layer> &layers, std::unordered_set<int> &flippedGIDs);
 
-	int getBlockIndex(const sf::Vector2i &pos, LayerType layerType);
+	/**
+	 * @return The index of the given tile in the given layer. Throws an exception
+	 * if the tile is out of bounds or the layer is not a tile layer
+	 */
+	int getTileIndex(const sf::Vector2i &pos, LayerType layerType) const;
+
+	static void rotateObject(sf::Vertex *quad, float degrees, const sf::Vector2f &pos);
 
-	int getVertexIndex(const sf::Vector2i &pos, LayerType layerType);
+	static void positionVertices(sf::Vertex *quad, const sf::Vector2i &pos, int delta);
 
-	void rotateObject(sf::Vertex *quad, float degrees, const sf::Vector2f &pos);
+	static void positionVertices(sf::Vertex *quad, const sf::Vector2f &pos, int delta);
 
-	void positionVertices(sf::Vertex *quad, const sf::Vector2i &pos, int delta);
+	/**
+	 * @return The position of the given object's top left corner, in tiles
+	 */
+	static sf::Vector2f getObjectPosition(const WorldObject &object);
 
-	void positionVertices(sf::Vertex *quad, const sf::Vector2f &pos, int delta);
+	/**
+	 * Builds the vertices of the given chunk, uncoloured. Only reads the tiles
+	 * and tileset, so may be called for different chunks from several threads at once
+	 */
+	void buildChunk(int chunk, TerrainChunk &out) const;
 
 	/**
-	 * @return The depth of the layer with the given type. Throws an exception if not found
+	 * Waits for and discards the worker build of the given chunk, if any,
+	 * as it is about to be made stale by a change to its tiles
 	 */
-	int getDepth(LayerType layerType) const;
+	void cancelChunkBuild(int chunk);
 
-	sf::VertexArray &getVertices(LayerType layerType);
+	/**
+	 * @return The quad of the given tile in the given chunk
+	 */
+	sf::Vertex *getChunkQuad(TerrainChunk &chunk, const sf::IntRect &bounds, const sf::Vector2i &pos,
+	                         LayerType layer) const;
+
+	void textureTile(sf::Vertex *quad, const sf::Vector2i &pos, const TileData &tile) const;
 
-	CollisionMap *getCollisionMap();
+	/**
+	 * @return The range of chunks overlapping the given region, in chunks
+	 */
+	sf::IntRect getChunkRange(const sf::FloatRect &tiles) const;
+
+	/**
+	 * Greedily merges the collidable tiles of the given chunk into as few
+	 * rects as possible, never merging different block types. This is 
+	 * linear in the number of tiles
+	 */
+	void meshCollidableTiles(int chunk, std::vector<CollisionRect> &rects);
+
+	void findCollidableObjects(int chunk, std::vector<CollisionRect> &rects);
+
+	/**
+	 * Traces the boundaries of the solid regions of the given chunk, 
+	 * keeping only the corners
+	 */
+	void traceCollisionOutlines(int chunk, std::vector<CollisionOutline> &outlines);
 
 protected:
 	sf::Vector2i size;
 
-	void resizeVertices();
+	void resizeTiles();
 
-	void render(sf::RenderTarget &target, sf::RenderStates &states, bool overLayers) const;
+	/**
+	 * Draws the built chunks in the given region
+	 */
+	void render(sf::RenderTarget &target, sf::RenderStates &states, const sf::FloatRect &visibleTiles,
+	            bool overLayers) const;
 
 	friend World;
 };
@@ -348,6 +1088,11 @@ public:
 	void getBuildingByOutsideDoorTile(const sf::Vector2i &tile,
 			boost::optional<std::pair<BuildingID, DoorID>> &out);
 
+	/**
+	 * Rediscovers the windows of all buildings overlapping the given region
+	 */
+	void discoverWindows(const sf::IntRect &region);
+
 private:
 	std::unordered_map<BuildingID, Building> buildings;
 };
@@ -361,6 +1106,9 @@ public:
 
 	WorldTerrain *getTerrain();
 
+	/**
+	 * @return The collision map of this instance, or null if it is not loaded
+	 */
 	CollisionMap *getCollisionMap() const;
 
 	ConnectionMap *getConnectionMap();
@@ -369,6 +1117,9 @@ public:
 
 	DomesticConnectionMap *getDomesticConnectionMap();
 
+	/**
+	 * @return The Box2D world of this instance. Throws an exception if not loaded
+	 */
 	b2World *getBox2DWorld() const;
 
 	sf::Vector2i getPixelSize() const;
@@ -377,6 +1128,22 @@ public:
 
 	sf::Transform getTransform() const;
 
+	/**
+	 * Streams collision chunks ready for the next step. Must be called on the main thread
+	 */
+	void prepareTick(float delta);
+
+	/**
+	 * Steps the physics of this world only, so may be called on a worker
+	 * thread while other worlds step
+	 */
+	void step(float delta);
+
+	/**
+	 * Raises the events queued during the last step. Must be called on the main thread
+	 */
+	void finishTick();
+
 	void tick(float delta);
 
 	WorldID getID() const;
@@ -390,6 +1157,29 @@ public:
 	 */
 	bool isEmpty();
 
+	/**
+	 * @return True if the per-instance state (physics and collisions) is loaded
+	 */
+	bool isLoaded() const;
+
+	/**
+	 * Creates the per-instance state of this world, if not already loaded.
+	 * The terrain and connection map must already be set
+	 */
+	void load();
+
+	/**
+	 * Takes ownership of a collision map that has already had its fixtures
+	 * created, e.g. by a background prefetch, and finishes loading
+	 * @param prefetched A collision map created for this world
+	 */
+	void load(CollisionMap *prefetched);
+
+	/**
+	 * Destroys the per-instance state of this world. The world must be empty
+	 */
+	void unload();
+
 private:
 	WorldID id;
 	std::string name;
@@ -397,6 +1187,7 @@ private:
 
 	WorldTerrain *terrain;
 	ConnectionMap *connectionMap; // todo use variant/container struct to avoid heap
+	std::unique_ptr<CollisionMap> collisionMap;
 
 	// todo move to a WorldRenderer
 	void draw(sf::RenderTarget &target, sf::RenderStates states) const override;
@@ -256,19 +256,41 @@ void AnimationService::processQueuedSprites()
 
 Animation *Animation::addRow(const sf::Vector2i &startPosition, const sf::Vector2i &spriteDimensions, int rowLength)
 {
-	Sequence seq;
+	if (sequenceCount != 0 && (int) frameCount != rowLength)
+		error("Animation rows must all be %1% frames long, not %2%", _str(frameCount), _str(rowLength));
 
 	sf::IntRect rect(startPosition, spriteDimensions);
 	for (int i = 0; i < rowLength; i++)
 	{
-		seq.push_back(rect);
+		frames.emplace_back(rect);
 		rect.left += spriteDimensions.x;
 	}
 
-	sequences.push_back(seq);
+	frameCount = rowLength;
+	++sequenceCount;
 	return this;
 }
 
+static float animationClock = 0.f;
+
+// sprite rows are ordered south, west, east, north
+static const size_t DIRECTION_SEQUENCES[] = {
+		3, // DIRECTION_NORTH
+		2, // DIRECTION_EAST
+		0, // DIRECTION_SOUTH
+		1  // DIRECTION_WEST
+};
+
+void Animator::tickClock(float delta)
+{
+	animationClock += delta;
+}
+
+float Animator::getClock()
+{
+	return animationClock;
+}
+
 Animator::Animator(Animation *anim, float step, DirectionType initialDirection, bool initiallyPlaying)
 {
 	init(anim, step, initialDirection, initiallyPlaying);
@@ -277,15 +299,13 @@ Animator::Animator(Animation *anim, float step, DirectionType initialDirection,
 void Animator::init(Animation *anim, float step, DirectionType initialDirection, bool initiallyPlaying)
 {
 	animation = anim;
-	ticker.setMinAndMax(step);
+	this->step = step;
 	currentSequence = 0;
-	currentFrame = 0;
 	playing = initiallyPlaying;
+	startFrame = 0;
+	startTime = animationClock;
 	direction = initialDirection;
 
-	vertices.setPrimitiveType(sf::Quads);
-	vertices.resize(4);
-
 	if (anim != nullptr)
 	{
 		direction = DIRECTION_UNKNOWN;
@@ -293,52 +313,36 @@ void Animator::init(Animation *anim, float step, DirectionType initialDirection,
 	}
 }
 
-void Animator::tick(float delta)
-{
-	if (!playing)
-		return;
-
-	// next frame
-	if (ticker.tick(delta))
-	{
-		if (++currentFrame >= animation->sequences.size())
-			currentFrame = 0;
-
-		updateFrame();
-	}
-}
-
 void Animator::turn(DirectionType direction, bool reset)
 {
 	if (direction == this->direction)
 		return;
 
 	this->direction = direction;
-
-	// convert direction to sequence
-	if (direction == DIRECTION_NORTH)
-		currentSequence = 3;
-	else if (direction == DIRECTION_EAST)
-		currentSequence = 2;
-	else if (direction == DIRECTION_WEST)
-		currentSequence = 1;
-	else if (direction == DIRECTION_SOUTH)
-		currentSequence = 0;
+	if (direction != DIRECTION_UNKNOWN)
+		currentSequence = DIRECTION_SEQUENCES[direction];
 
 	if (reset)
-		currentFrame = 0;
-
-	updateFrame();
+	{
+		startFrame = 0;
+		startTime = animationClock;
+	}
 }
 
 void Animator::setPlaying(bool playing, bool reset)
 {
-	this->playing = playing;
+	if (playing != this->playing)
+	{
+		// continue from the same frame
+		startFrame = getCurrentFrame();
+		startTime = animationClock;
+		this->playing = playing;
+	}
 
 	if (reset)
 	{
-		currentFrame = 0;
-		updateFrame();
+		startFrame = 0;
+		startTime = animationClock;
 	}
 }
 
@@ -347,35 +351,50 @@ void Animator::togglePlaying(bool resetEachTime)
 	setPlaying(!playing, resetEachTime);
 }
 
-void Animator::resizeVertices(float width, float height)
+bool Animator::isPlaying() const
 {
-	if (width == currentSize.x && height == currentSize.y)
-		return;
-
-	vertices[0].position = sf::Vector2f(0, 0);
-	vertices[1].position = sf::Vector2f(width, 0);
-	vertices[2].position = sf::Vector2f(width, height);
-	vertices[3].position = sf::Vector2f(0, height);
-
-	currentSize.x = width;
-	currentSize.y = height;
+	return playing;
 }
 
-void Animator::updateFrame()
+size_t Animator::getCurrentFrame() const
 {
-	Animation::Sequence sequence(animation->sequences[currentSequence]);
-	sf::FloatRect rect(sequence[currentFrame]);
+	if (animation == nullptr || animation->frameCount == 0)
+		return 0;
 
-	resizeVertices(rect.width, rect.height);
+	size_t frame = startFrame;
+	if (playing && step > 0.f)
+		frame += (size_t) ((animationClock - startTime) / step);
 
-	vertices[0].texCoords = sf::Vector2f(rect.left, rect.top);
-	vertices[1].texCoords = sf::Vector2f(rect.left + rect.width, rect.top);
-	vertices[2].texCoords = sf::Vector2f(rect.left + rect.width, rect.top + rect.height);
-	vertices[3].texCoords = sf::Vector2f(rect.left, rect.top + rect.height);
+	return frame % animation->frameCount;
 }
 
 void Animator::draw(sf::RenderTarget &target, sf::RenderStates states) const
 {
+	sf::VertexArray quad(sf::Quads);
+	appendQuad(quad, sf::Vector2f(), 1.f);
+
 	states.texture = animation->texture;
-	target.draw(vertices, states);
+	target.draw(quad, states);
+}
+
+void Animator::appendQuad(sf::VertexArray &batch, const sf::Vector2f &origin, float scale) const
+{
+	if (animation == nullptr || animation->frameCount == 0)
+		return;
+
+	const sf::FloatRect &frame = animation->getFrame(currentSequence, getCurrentFrame());
+	float width = frame.width * scale;
+	float height = frame.height * scale;
+	float right = frame.left + frame.width;
+	float bottom = frame.top + frame.height;
+
+	batch.append(sf::Vertex(origin, sf::Vector2f(frame.left, frame.top)));
+	batch.append(sf::Vertex(sf::Vector2f(origin.x + width, origin.y), sf::Vector2f(right, frame.top)));
+	batch.append(sf::Vertex(sf::Vector2f(origin.x + width, origin.y + height), sf::Vector2f(right, bottom)));
+	batch.append(sf::Vertex(sf::Vector2f(origin.x, origin.y + height), sf::Vector2f(frame.left, bottom)));
+}
+
+const sf::Texture *Animator::getTexture() const
+{
+	return animation == nullptr ? nullptr : animation->texture;
 }
@@ -1,4 +1,5 @@
 #include "ecs.hpp"
+#include "world.hpp"
 #include "Box2D/Box2D.h"
 
 
@@ -15,17 +16,22 @@ void InputComponent::reset()
 
 sf::Vector2f PhysicsComponent::getTilePosition() const
 {
+	if (backend == MOVEMENT_GRID)
+		return grid->getPosition(agent);
+
 	return Utils::fromB2Vec<float>(body->GetPosition());
 }
 
 sf::Vector2f PhysicsComponent::getPosition() const
 {
-	b2Vec2 pos(body->GetPosition());
-	return Utils::toPixel(Utils::fromB2Vec<float>(pos));
+	return Utils::toPixel(getTilePosition());
 }
 
 sf::Vector2f PhysicsComponent::getVelocity() const
 {
+	if (backend == MOVEMENT_GRID)
+		return grid->getVelocity(agent);
+
 	b2Vec2 v = body->GetLinearVelocity();
 	return Utils::fromB2Vec<float>(v);
 }
@@ -37,7 +43,18 @@ sf::Vector2f PhysicsComponent::getLastVelocity() const
 
 void PhysicsComponent::setVelocity(const sf::Vector2f &velocity)
 {
-	body->SetLinearVelocity(Utils::toB2Vec(velocity));
+	if (backend == MOVEMENT_GRID)
+		grid->setVelocity(agent, velocity);
+	else
+		body->SetLinearVelocity(Utils::toB2Vec(velocity));
+}
+
+void PhysicsComponent::setLinearDamping(float linearDamping)
+{
+	if (backend == MOVEMENT_GRID)
+		grid->setDamping(agent, linearDamping);
+	else
+		body->SetLinearDamping(linearDamping);
 }
 
 bool PhysicsComponent::isStopped()
@@ -53,6 +70,17 @@ bool PhysicsComponent::isSteering()
 
 void PhysicsComponent::getAABB(b2AABB &out)
 {
+	// the circle at the feet
+	if (backend == MOVEMENT_GRID)
+	{
+		sf::Vector2f pos = getTilePosition();
+		float radius = grid->getRadius();
+		float feet = Constants::entityScalef / 2 * 0.75f;
+		out.lowerBound = b2Vec2(pos.x - radius, pos.y + feet - radius);
+		out.upperBound = b2Vec2(pos.x + radius, pos.y + feet + radius);
+		return;
+	}
+
 	// merci http://gamedev.stackexchange.com/a/1373
 	out.lowerBound = b2Vec2(FLT_MAX, FLT_MAX);
 	out.upperBound = b2Vec2(-FLT_MAX, -FLT_MAX);
@@ -68,9 +96,17 @@ void PhysicsComponent::getAABB(b2AABB &out)
 void PhysicsComponent::reset()
 {
 	world = 0;
+	entityCollision = true;
+	backend = MOVEMENT_BOX2D;
 	if (body != nullptr)
 	{
 		bWorld->DestroyBody(body);
 		body = nullptr;
 	}
+
+	if (grid != nullptr)
+	{
+		grid->removeAgent(agent);
+		grid = nullptr;
+	}
 }
@@ -1,7 +1,10 @@
+#include <algorithm>
 #include "ecs.hpp"
 #include "ai.hpp"
 #include "service/entity_service.hpp"
 #include "service/config_service.hpp"
+#include "service/world_service.hpp"
+#include "service/locator.hpp"
 
 void System::tick(EntityService *es, float dt)
 {
@@ -21,25 +24,251 @@ void System::render(EntityService *es, WorldID currentWorld, sf::RenderWindow &w
 	}
 }
 
-void RenderSystem::tickEntity(EntityService *es, EntityID e, float dt)
+void RenderSystem::render(EntityService *es, WorldID currentWorld, sf::RenderWindow &window)
+{
+	for (auto &pair : batches)
+	{
+		pair.second.setPrimitiveType(sf::Quads);
+		pair.second.clear();
+	}
+
+	World *world = Locator::locate<WorldService>()->getWorld(currentWorld);
+	if (world == nullptr || !world->isLoaded())
+	{
+		visible.clear();
+		lastDrawCalls = 0;
+		return;
+	}
+
+	// sprites extend past their position
+	const float margin = Constants::entityScalef;
+	sf::FloatRect region(visibleTiles.left - margin, visibleTiles.top - margin,
+	                     visibleTiles.width + margin * 2, visibleTiles.height + margin * 2);
+
+	visible.clear();
+	world->getCollisionMap()->queryEntities(region, visible);
+
+	visible.erase(std::remove_if(visible.begin(), visible.end(), [es, this](EntityID e)
+	{
+		return (es->getComponentMask(e) & mask) != mask;
+	}), visible.end());
+
+	// too small to make out sprites, so only their positions matter
+	float tilePixels = window.getSize().x / visibleTiles.width;
+	if (tilePixels * Constants::entityScalef < Config::getFloat("world.lod.entity-point-pixels", 6.f))
+	{
+		const float screenPixels = 2.f;
+		renderPoints(es, screenPixels * Constants::tileSizef / tilePixels, window);
+		return;
+	}
+
+	renderVelocities = Config::getBool("debug.render-physics", false);
+	debugLines.setPrimitiveType(sf::Lines);
+	debugLines.clear();
+
+	// by the centre of their bodies, which is their feet less the same offset
+	// for every entity, so nearer entities are drawn over those behind; within
+	// each texture's batch at least, as batches are drawn one after another
+	drawOrder.update(visible, [es](EntityID e)
+	{
+		return es->getComponent<PhysicsComponent>(e, COMPONENT_PHYSICS)->getTilePosition().y;
+	});
+
+	for (EntityID e : drawOrder.getOrder())
+		renderEntity(es, e, currentWorld, window);
+
+	lastDrawCalls = 0;
+	for (auto &pair : batches)
+	{
+		if (pair.second.getVertexCount() == 0)
+			continue;
+
+		sf::RenderStates states;
+		states.texture = pair.first;
+		window.draw(pair.second, states);
+		++lastDrawCalls;
+	}
+
+	if (debugLines.getVertexCount() != 0)
+		window.draw(debugLines);
+}
+
+void RenderSystem::renderPoints(EntityService *es, float pointSize, sf::RenderWindow &window)
+{
+	static const sf::Color colour(230, 60, 50);
+
+	points.setPrimitiveType(sf::Quads);
+	points.clear();
+
+	for (EntityID e : visible)
+	{
+		sf::Vector2f pos = Utils::toPixel(es->getComponent<PhysicsComponent>(e, COMPONENT_PHYSICS)->getTilePosition());
+		pos -= sf::Vector2f(pointSize / 2, pointSize / 2);
+
+		points.append(sf::Vertex(pos, colour));
+		points.append(sf::Vertex(sf::Vector2f(pos.x + pointSize, pos.y), colour));
+		points.append(sf::Vertex(sf::Vector2f(pos.x + pointSize, pos.y + pointSize), colour));
+		points.append(sf::Vertex(sf::Vector2f(pos.x, pos.y + pointSize), colour));
+	}
+
+	window.draw(points);
+	lastDrawCalls = points.getVertexCount() == 0 ? 0 : 1;
+}
+
+int RenderSystem::getLastDrawCalls() const
+{
+	return lastDrawCalls;
+}
+
+void RenderSystem::setVisibleTiles(const sf::FloatRect &tiles)
+{
+	visibleTiles = tiles;
+}
+
+int RenderSystem::getLastVisibleCount() const
+{
+	return (int) visible.size();
+}
+
+const std::vector<EntityID> &RenderSystem::getDrawOrder() const
+{
+	return drawOrder.getOrder();
+}
+
+int DepthOrder::update(const std::vector<EntityID> &entities, const std::function<float(EntityID)> &getDepth)
+{
+	++updates;
+	for (EntityID e : entities)
+	{
+		if (e >= (EntityID) seen.size())
+			seen.resize(e + 1, 0);
+		seen[e] = updates;
+	}
+
+	// keep those still present, in their last order
+	std::size_t kept = 0;
+	for (EntityID e : order)
+	{
+		if (seen[e] != updates)
+			continue;
+
+		order[kept++] = e;
+		seen[e] = -updates; // placed
+	}
+	order.resize(kept);
+
+	for (EntityID e : entities)
+	{
+		if (seen[e] != updates)
+			continue;
+
+		order.push_back(e);
+		seen[e] = -updates;
+	}
+
+	depths.resize(order.size());
+	for (std::size_t i = 0; i < order.size(); ++i)
+		depths[i] = getDepth(order[i]);
+
+	// nearly sorted already, unless many entities changed row
+	int shifts = 0;
+	for (std::size_t i = 1; i < order.size(); ++i)
+	{
+		EntityID e = order[i];
+		float depth = depths[i];
+
+		std::size_t j = i;
+		while (j > 0 && (depths[j - 1] > depth || (depths[j - 1] == depth && order[j - 1] > e)))
+		{
+			order[j] = order[j - 1];
+			depths[j] = depths[j - 1];
+			--j;
+			++shifts;
+		}
+
+		order[j] = e;
+		depths[j] = depth;
+	}
+
+	return shifts;
+}
+
+const std::vector<EntityID> &DepthOrder::getOrder() const
+{
+	return order;
+}
+
+void RenderSystem::tick(EntityService *es, float)
+{
+	// gathered directly, rather than through tickEntity for each
+	for (EntityID e = 0; e < MAX_ENTITIES; ++e)
+	{
+		if ((es->getComponentMask(e) & mask) == mask)
+			queueAnimation(es, e);
+	}
+
+	animateQueued(es);
+}
+
+void RenderSystem::tickEntity(EntityService *es, EntityID e, float)
+{
+	queueAnimation(es, e);
+	animateQueued(es);
+}
+
+void RenderSystem::queueAnimation(EntityService *es, EntityID e)
 {
 	auto *render = es->getComponent<RenderComponent>(e, COMPONENT_RENDER);
+
+	// nothing to animate until woken, once the animation has been stopped
+	if (es->isAsleep(e) && !render->anim.isPlaying())
+		return;
+
 	auto *physics = es->getComponent<PhysicsComponent>(e, COMPONENT_PHYSICS);
+	sf::Vector2f velocity = physics->getVelocity();
+	sf::Vector2f lastVelocity = physics->getLastVelocity();
 
-	// set playing
-	bool stopAnimation = !physics->isSteering() && physics->isStopped();
+	animated.push_back(e);
+	velocityX.push_back(velocity.x);
+	velocityY.push_back(velocity.y);
+	lastVelocityX.push_back(lastVelocity.x);
+	lastVelocityY.push_back(lastVelocity.y);
+	steering.push_back(physics->isSteering());
+}
 
-	render->anim.setPlaying(!stopAnimation, stopAnimation);
+void RenderSystem::animateQueued(EntityService *es)
+{
+	const std::size_t count = animated.size();
+	playing.resize(count);
+	directions.resize(count);
 
-	// change animation direction
+	// face the last movement once stopped
 	// todo get this from orientation instead of movement
-	sf::Vector2f directionVector = physics->isStopped() ? physics->getLastVelocity() : physics->getVelocity();
-	double angleDeg = atan2(directionVector.y, directionVector.x) * Math::radToDeg;
-	DirectionType direction = Direction::fromAngle(angleDeg);
-	render->anim.turn(direction, false);
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		bool stopped = velocityX[i] * velocityX[i] + velocityY[i] * velocityY[i] < 1.f;
+		playing[i] = steering[i] | !stopped;
+		velocityX[i] = stopped ? lastVelocityX[i] : velocityX[i];
+		velocityY[i] = stopped ? lastVelocityY[i] : velocityY[i];
+	}
 
-	// advance animation frame
-	render->anim.tick(dt);
+	// several at once where supported
+	Direction::fromVectors(velocityX.data(), velocityY.data(), count, directions.data());
+
+	// only then written back, from the packed results
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		Animator &anim = es->getComponent<RenderComponent>(animated[i], COMPONENT_RENDER)->anim;
+		anim.setPlaying(playing[i] != 0, playing[i] == 0);
+		anim.turn((DirectionType) directions[i], false);
+	}
+
+	animated.clear();
+	velocityX.clear();
+	velocityY.clear();
+	lastVelocityX.clear();
+	lastVelocityY.clear();
+	steering.clear();
 }
 
 void InputSystem::tickEntity(EntityService *es, EntityID e, float dt)
@@ -51,9 +280,18 @@ void PhysicsSystem::tickEntity(EntityService *es, EntityID e, float /* dt */)
 {
 	auto *physics = es->getComponent<PhysicsComponent>(e, COMPONENT_PHYSICS);
 
+	// woken by steering, or by being pushed
+	if (es->isAsleep(e))
+	{
+		sf::Vector2f velocity = physics->getVelocity();
+		if (!physics->isSteering() && velocity.x == 0.f && velocity.y == 0.f)
+			return;
+
+		es->setAsleep(e, false);
+	}
+
 	// move
-	physics->body->SetLinearVelocity(
-			physics->body->GetLinearVelocity() + physics->steering);
+	physics->setVelocity(physics->getVelocity() + Utils::fromB2Vec<float>(physics->steering));
 
 	// maximum speed
 	float maxSpeed = physics->maxSpeed;
@@ -62,55 +300,51 @@ void PhysicsSystem::tickEntity(EntityService *es, EntityID e, float /* dt */)
 		physics->setVelocity(Math::truncate(physics->getVelocity(), maxSpeed));
 
 		// remove damping
-		physics->body->SetLinearDamping(0.f);
+		physics->setLinearDamping(0.f);
 	}
 	else
-		physics->body->SetLinearDamping(physics->damping);
+		physics->setLinearDamping(physics->damping);
 
 	// stop
 	if (physics->isStopped())
-		physics->body->SetLinearVelocity({0.f, 0.f});
+		physics->setVelocity({0.f, 0.f});
 
 	// store current velocity for next step
 	auto vel(physics->getVelocity());
 	if (vel.x != 0.f || vel.y != 0.f)
 		physics->lastVelocity = Utils::toB2Vec(physics->getVelocity());
-}
 
-void tempDrawVector(PhysicsComponent *physics, const sf::Vector2f vector, sf::Color colour, sf::RenderWindow &window)
-{
-	sf::RectangleShape r;
-	r.rotate(atan2(vector.y, vector.x) * Math::radToDeg);
-	r.move(physics->getPosition());
-	r.setSize(sf::Vector2f(Math::length(vector) * Constants::tileSizef / 2, 1.0f));
-	r.setFillColor(colour);
-	window.draw(r);
+	// stationary
+	else if (!physics->isSteering())
+		es->setAsleep(e, true);
 }
 
-void RenderSystem::renderEntity(EntityService *es, EntityID e, WorldID currentWorld, sf::RenderWindow &window)
+void RenderSystem::renderEntity(EntityService *es, EntityID e, WorldID currentWorld, sf::RenderWindow &)
 {
 	auto *physics = es->getComponent<PhysicsComponent>(e, COMPONENT_PHYSICS);
 	if (physics->world != currentWorld)
 		return;
 
 	auto render = es->getComponent<RenderComponent>(e, COMPONENT_RENDER);
-
-	sf::RenderStates states;
-	sf::Transform transform;
+	const sf::Texture *texture = render->anim.getTexture();
+	if (texture == nullptr)
+		return;
 
 	sf::Vector2f offsetPosition = physics->getTilePosition();
 	const float offset = 0.5f * Constants::entityScalef;
 	offsetPosition.x -= offset;
 	offsetPosition.y -= offset;
 
+	// drawn with the rest of its texture's batch
 	const float scale = Constants::entityScalef * Constants::scale / 2.f;
-	transform.translate(Utils::toPixel(offsetPosition));
-	transform.scale(scale, scale);
-
-	states.transform *= transform;
-	render->anim.draw(window, states);
+	sf::VertexArray &batch = batches[texture];
+	render->anim.appendQuad(batch, Utils::toPixel(offsetPosition), scale);
 
 	// debug
-	if (Config::getBool("debug.render-physics", false))
-		tempDrawVector(physics, physics->getVelocity(), sf::Color::Green, window);
+	if (renderVelocities)
+	{
+		sf::Vector2f velocity = physics->getVelocity() * (Constants::tileSizef / 2);
+		debugLines.append(sf::Vertex(physics->getPosition(), sf::Color::Green));
+		debugLines.append(sf::Vertex(physics->getPosition() + velocity, sf::Color::Green));
+	}
 }
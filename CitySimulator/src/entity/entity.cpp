@@ -16,7 +16,14 @@ void EntityService::onEnable()
 
 	// init entities
 	for (size_t i = 0; i < MAX_ENTITIES; ++i)
+	{
 		entities[i] = COMPONENT_UNKNOWN;
+		recycledMasks[i] = COMPONENT_UNKNOWN;
+	}
+
+	despawnCount = 0;
+	recycleHits = 0;
+	recycleMisses = 0;
 
 	// init systems in correct order
 	systems.push_back(new InputSystem);
@@ -85,6 +92,10 @@ void EntityService::loadEntities(ConfigurationFile &config, EntityType entityTyp
 
 void EntityService::onDisable()
 {
+	if (recycleHits + recycleMisses > 0)
+		Logger::logDebug(format("Recycled %1% of %2% spawned entities",
+					_str(recycleHits), _str(recycleHits + recycleMisses)));
+
 	for (System *system : systems)
 		delete system;
 }
@@ -102,21 +113,31 @@ EntityID EntityService::createEntity()
 
 	// todo: use a memory pool instead to avoid iterating the entire array each time
 	for (EntityID e = 0; e < MAX_ENTITIES; ++e)
-		if (!isAlive(e))
+		if (!isAlive(e) && recycledMasks[e] == COMPONENT_UNKNOWN)
 		{
 			entityCount++;
+			prototypes[e].clear();
 			return e;
 		}
 
-	return MAX_ENTITIES;
+	// make room by forgetting a despawned entity
+	EntityID e = reclaimRecycledEntity();
+	if (e != MAX_ENTITIES)
+	{
+		entityCount++;
+		prototypes[e].clear();
+	}
+
+	return e;
 }
 
-EntityIdentifier *EntityService::createEntity(EntityType type)
+EntityIdentifier *EntityService::createEntity(EntityType type, const std::string &prototype)
 {
 	EntityID e = createEntity();
 	EntityIdentifier *id = &identifiers[e];
 	id->id = e;
 	id->type = type;
+	prototypes[e] = prototype;
 	return id;
 }
 
@@ -134,6 +155,95 @@ void EntityService::killEntity(EntityID e)
 		entityCount--;
 
 	entities[e] = COMPONENT_UNKNOWN;
+	asleep.reset(e);
+}
+
+void EntityService::despawnEntity(EntityID e)
+{
+	validateEntity(e);
+	if (!isAlive(e))
+		return;
+
+	// keep the body out of the broadphase until it is needed again
+	if (hasComponent(e, COMPONENT_PHYSICS))
+		removeFromWorld(e);
+
+	recycledMasks[e] = entities[e];
+	despawnOrder[e] = despawnCount++;
+	recycledEntities[std::make_pair(identifiers[e].type, prototypes[e])].push_back(e);
+	killEntity(e);
+}
+
+EntityIdentifier *EntityService::recycleEntity(EntityType type, const std::string &prototype, World *world,
+                                               const sf::Vector2i &startTilePos)
+{
+	auto recycled = recycledEntities.find(std::make_pair(type, prototype));
+	if (recycled == recycledEntities.end() || recycled->second.empty())
+	{
+		++recycleMisses;
+		return nullptr;
+	}
+
+	// the most recently used is the most likely to still be cached
+	EntityID e = recycled->second.back();
+	recycled->second.pop_back();
+	++recycleHits;
+
+	entities[e] = recycledMasks[e];
+	recycledMasks[e] = COMPONENT_UNKNOWN;
+	entityCount++;
+
+	EntityIdentifier &entity = identifiers[e];
+	if (hasComponent(e, COMPONENT_PHYSICS))
+	{
+		if (world == nullptr)
+			error("Cannot recycle entity %1% with a physics component without a world", _str(e));
+
+		World *instance = Locator::locate<WorldService>()->instantiateWorld(world->getID());
+		sf::Vector2f pos(static_cast<float>(startTilePos.x), static_cast<float>(startTilePos.y));
+
+		// before placing, as it decides the body's collision filter
+		PhysicsComponent *phys = getComponent<PhysicsComponent>(e, COMPONENT_PHYSICS);
+		phys->entityCollision = collidesWithEntities(type, prototype);
+		phys->steering.SetZero();
+		placeInWorld(e, instance, pos);
+	}
+
+	return &entity;
+}
+
+const std::string &EntityService::getPrototype(EntityID e) const
+{
+	validateEntity(e);
+	return prototypes[e];
+}
+
+float EntityService::getRecycleHitRate() const
+{
+	int total = recycleHits + recycleMisses;
+	return total == 0 ? 0.f : recycleHits / static_cast<float>(total);
+}
+
+EntityID EntityService::reclaimRecycledEntity()
+{
+	// each queue is in despawn order, so the oldest is at the front of one of them
+	std::deque<EntityID> *oldest = nullptr;
+	for (auto &pair : recycledEntities)
+	{
+		std::deque<EntityID> &recycled = pair.second;
+		if (!recycled.empty() &&
+		    (oldest == nullptr || despawnOrder[recycled.front()] < despawnOrder[oldest->front()]))
+			oldest = &recycled;
+	}
+
+	if (oldest == nullptr)
+		return MAX_ENTITIES;
+
+	// its parked body is left to its world
+	EntityID e = oldest->front();
+	oldest->pop_front();
+	recycledMasks[e] = COMPONENT_UNKNOWN;
+	return e;
 }
 
 bool EntityService::isAlive(EntityID e) const
@@ -142,6 +252,22 @@ bool EntityService::isAlive(EntityID e) const
 	return entities[e] != COMPONENT_UNKNOWN;
 }
 
+bool EntityService::isAsleep(EntityID e) const
+{
+	return asleep.test(e);
+}
+
+void EntityService::setAsleep(EntityID e, bool asleep)
+{
+	validateEntity(e);
+	this->asleep.set(e, asleep);
+}
+
+unsigned int EntityService::getAsleepCount() const
+{
+	return asleep.count();
+}
+
 EntityID EntityService::getComponentMask(EntityID e) const
 {
 	if (e < 0 || e >= MAX_ENTITIES)
@@ -152,12 +278,16 @@ EntityID EntityService::getComponentMask(EntityID e) const
 
 void EntityService::tickSystems(float delta)
 {
+	// animation frames are derived from this, rather than ticked per entity
+	Animator::tickClock(delta);
+
 	for (System *system : systems)
 		system->tick(this, delta);
 }
 
-void EntityService::renderSystems(WorldID currentWorld)
+void EntityService::renderSystems(WorldID currentWorld, const sf::FloatRect &visibleTiles)
 {
+	renderSystem->setVisibleTiles(visibleTiles);
 	renderSystem->render(this, currentWorld, *Locator::locate<RenderService>()->getWindow());
 }
 
@@ -165,6 +295,7 @@ BaseComponent *EntityService::addComponent(EntityID e, ComponentType type)
 {
 	validateEntity(e);
 	entities[e] |= type;
+	asleep.reset(e);
 
 	auto comp = getComponentOfType(e, type);
 	comp->reset();
@@ -204,22 +335,92 @@ BaseComponent *EntityService::getComponentOfType(EntityID e, ComponentType type)
 void EntityService::addPhysicsComponent(EntityIdentifier &entity, World *world,
 										const sf::Vector2i &startTilePos,
 										float maxSpeed,
-										float damping)
+										float damping,
+										bool entityCollision)
 {
 	PhysicsComponent *phys = dynamic_cast<PhysicsComponent *>(addComponent(entity.id, COMPONENT_PHYSICS));
 
 	phys->maxSpeed = maxSpeed;
 	phys->damping = damping;
+	phys->entityCollision = entityCollision;
 
-	b2World *bWorld = world->getBox2DWorld();
-	phys->bWorld = bWorld;
-	phys->world = world->getID();
+	// for comparing the two
+	if (Config::getString("world.movement-backend", "box2d") == "grid")
+		phys->backend = MOVEMENT_GRID;
 
+	World *instance = Locator::locate<WorldService>()->instantiateWorld(world->getID());
 	sf::Vector2f pos(static_cast<float>(startTilePos.x), static_cast<float>(startTilePos.y));
-	phys->body = createBody(bWorld, entity, pos);
+	placeInWorld(entity.id, instance, pos);
+}
+
+void EntityService::placeInWorld(EntityID e, World *world, const sf::Vector2f &pos)
+{
+	validateEntity(e);
+	PhysicsComponent *phys = &physicsComponents[e];
+	phys->world = world->getID();
+	asleep.reset(e);
+
+	if (phys->backend == MOVEMENT_GRID)
+	{
+		phys->grid = world->getCollisionMap()->getAgentGrid();
+		phys->agent = phys->grid->addAgent(e, pos, phys->entityCollision);
+		return;
+	}
+
+	BodyData *data = &bodyData[e];
+	data->type = BODYDATA_ENTITY;
+	data->entityID = identifiers[e];
+
+	phys->bWorld = world->getBox2DWorld();
+	phys->body = world->getCollisionMap()->unparkEntityBody(data, getEntityFilter(e), pos);
+	if (phys->body == nullptr)
+		phys->body = createBody(phys->bWorld, identifiers[e], pos);
+}
+
+void EntityService::removeFromWorld(EntityID e)
+{
+	validateEntity(e);
+	PhysicsComponent *phys = &physicsComponents[e];
+
+	if (phys->backend == MOVEMENT_GRID)
+	{
+		phys->grid->removeAgent(phys->agent);
+		phys->grid = nullptr;
+		return;
+	}
+
+	World *world = Locator::locate<WorldService>()->getWorld(phys->world);
+	world->getCollisionMap()->parkEntityBody(phys->body);
+	phys->body = nullptr;
+	phys->bWorld = nullptr;
 }
 
 
+b2Filter EntityService::getEntityFilter(EntityID e) const
+{
+	b2Filter filter;
+	filter.categoryBits = COLLISION_ENTITY;
+	filter.maskBits = COLLISION_TERRAIN | COLLISION_DOOR;
+	if (physicsComponents[e].entityCollision)
+		filter.maskBits |= COLLISION_ENTITY;
+
+	return filter;
+}
+
+bool EntityService::collidesWithEntities(EntityType type, const std::string &name) const
+{
+	auto tags = loadedTags.find(type);
+	if (tags == loadedTags.end())
+		return true;
+
+	auto entity = tags->second.find(name);
+	if (entity == tags->second.end())
+		return true;
+
+	auto tag = entity->second.find("entity-collision");
+	return tag == entity->second.end() || tag->second != "false";
+}
+
 void EntityService::addRenderComponent(const EntityIdentifier &entity, const std::string &animation, float step,
 									   DirectionType initialDirection, bool playing)
 {
@@ -258,11 +459,11 @@ b2Body *EntityService::createBody(b2World *world, b2Body *clone, const sf::Vecto
 b2Body *EntityService::createBody(b2World *world, b2Body *clone)
 {
 	sf::Vector2f pos = Utils::fromB2Vec<float>(clone->GetPosition());
-	BodyData *bodyData = static_cast<BodyData*>(clone->GetFixtureList()->GetUserData());
-	if (bodyData->type != BODYDATA_ENTITY)
+	BodyData *cloneData = static_cast<BodyData*>(clone->GetFixtureList()->GetUserData());
+	if (cloneData->type != BODYDATA_ENTITY)
 		error("Cannot clone non-entities");
 
-	EntityIdentifier &id = bodyData->entityID;
+	EntityIdentifier &id = cloneData->entityID;
 	return createBody(world, id, pos);
 }
 
@@ -290,10 +491,13 @@ b2Body *EntityService::createBody(b2World *world, EntityIdentifier &entity, cons
 	fixDef.density = 985.f;
 	fixDef.shape = &aabb;
 
-	BodyData *bodyData = new BodyData; // todo make sure to delete bodydata when deleting body (or cache)
-	bodyData->type = BODYDATA_ENTITY;
-	bodyData->entityID = entity;
-	fixDef.userData = bodyData;
+	validateEntity(entity.id);
+	fixDef.filter = getEntityFilter(entity.id);
+
+	BodyData *data = &bodyData[entity.id];
+	data->type = BODYDATA_ENTITY;
+	data->entityID = entity;
+	fixDef.userData = data;
 
 	ret->CreateFixture(&fixDef);
 
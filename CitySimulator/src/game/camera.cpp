@@ -117,7 +117,7 @@ CameraService::WorldChangeListener::WorldChangeListener(CameraService *cs) : cs(
 void CameraService::WorldChangeListener::onEvent(const Event &event)
 {
 	WorldService *ws = Locator::locate<WorldService>();
-	World *newWorld = ws->getWorld(event.cameraSwitchWorld.newWorld); // todo never return null
+	World *newWorld = ws->instantiateWorld(event.cameraSwitchWorld.newWorld);
 
 	cs->world = newWorld;
 	cs->view.setCenter((float) event.cameraSwitchWorld.centreX, (float) event.cameraSwitchWorld.centreY);
@@ -4,12 +4,25 @@
 EntityIdentifier &createTestHuman(World &world, int x, int y, const std::string &skin, DirectionType direction)
 {
 	EntityService *es = Locator::locate<EntityService>();
+	float maxSpeed = Config::getFloat("debug.movement.max-speed.walk");
+	float damping = Config::getFloat("debug.movement.stop-decay");
 
-	EntityIdentifier *entity = es->createEntity(ENTITY_HUMAN);
-
-	es->addPhysicsComponent(*entity, &world, {x, y}, Config::getFloat("debug.movement.max-speed.walk"),
-							Config::getFloat("debug.movement.stop-decay"));
+	// a despawned human of the same skin
+	EntityIdentifier *entity = es->recycleEntity(ENTITY_HUMAN, skin, &world, {x, y});
+	if (entity != nullptr)
+	{
+		PhysicsComponent *phys = es->getComponent<PhysicsComponent>(entity->id, COMPONENT_PHYSICS);
+		phys->maxSpeed = maxSpeed;
+		phys->damping = damping;
+	}
+	else
+	{
+		entity = es->createEntity(ENTITY_HUMAN, skin);
+		es->addPhysicsComponent(*entity, &world, {x, y}, maxSpeed, damping,
+		                        es->collidesWithEntities(ENTITY_HUMAN, skin));
+	}
 
+	// fresh animation and brain either way
 	es->addRenderComponent(*entity, skin, 0.2f, direction, false);
 	es->addAIInputComponent(entity->id);
 
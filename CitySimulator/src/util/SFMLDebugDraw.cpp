@@ -14,113 +14,200 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <unordered_set>
 #include <SFML/Graphics.hpp>
 #include "SFMLDebugDraw.h"
 
-SFMLDebugDraw::SFMLDebugDraw(sf::RenderWindow &window) : m_window(&window)
+SFMLDebugDraw::SFMLDebugDraw(sf::RenderWindow &window) : m_window(&window), m_lines(sf::Lines), m_triangles(sf::Triangles)
 {
 }
 
+/// Flooring the coords to fix distorted lines on flat surfaces, they still show up though.. but less frequently
+static sf::Vector2f FlooredVec(const b2Vec2 &vector)
+{
+	sf::Vector2f transformedVec = SFMLDebugDraw::B2VecToSFVec(vector);
+	return sf::Vector2f(std::floor(transformedVec.x), std::floor(transformedVec.y));
+}
+
+void SFMLDebugDraw::AppendLine(const sf::Vector2f &p1, const sf::Vector2f &p2, const sf::Color &color)
+{
+	m_lines.append(sf::Vertex(p1, color));
+	m_lines.append(sf::Vertex(p2, color));
+}
+
+void SFMLDebugDraw::AppendCircle(const b2Vec2 &center, float32 radius, const sf::Color &color, bool solid)
+{
+	const int segments = 16;
+	const float32 increment = 2.f * b2_pi / segments;
+
+	sf::Vector2f centre = SFMLDebugDraw::B2VecToSFVec(center);
+	sf::Vector2f last = SFMLDebugDraw::B2VecToSFVec(center + b2Vec2(radius, 0.f));
+	sf::Color fill(color.r, color.g, color.b, 60);
+
+	for (int i = 1; i <= segments; i++)
+	{
+		float32 angle = i * increment;
+		sf::Vector2f next = SFMLDebugDraw::B2VecToSFVec(center + radius * b2Vec2(cosf(angle), sinf(angle)));
+
+		if (solid)
+		{
+			m_triangles.append(sf::Vertex(centre, fill));
+			m_triangles.append(sf::Vertex(last, fill));
+			m_triangles.append(sf::Vertex(next, fill));
+		}
+
+		AppendLine(last, next, color);
+		last = next;
+	}
+}
+
 void SFMLDebugDraw::DrawPolygon(const b2Vec2 *vertices, int32 vertexCount, const b2Color &color)
 {
-	sf::ConvexShape polygon(vertexCount);
-	sf::Vector2f center;
+	sf::Color outline = SFMLDebugDraw::GLColorToSFML(color);
 	for (int i = 0; i < vertexCount; i++)
-	{
-		//polygon.setPoint(i, SFMLDraw::B2VecToSFVec(vertices[i]));
-		sf::Vector2f transformedVec = SFMLDebugDraw::B2VecToSFVec(vertices[i]);
-		polygon.setPoint(i, sf::Vector2f(std::floor(transformedVec.x), std::floor(
-				transformedVec.y))); // flooring the coords to fix distorted lines on flat surfaces
-	} // they still show up though.. but less frequently
-	polygon.setOutlineThickness(-1.f);
-	polygon.setFillColor(sf::Color::Transparent);
-	polygon.setOutlineColor(SFMLDebugDraw::GLColorToSFML(color));
-
-	m_window->draw(polygon);
+		AppendLine(FlooredVec(vertices[i]), FlooredVec(vertices[(i + 1) % vertexCount]), outline);
 }
 
 void SFMLDebugDraw::DrawSolidPolygon(const b2Vec2 *vertices, int32 vertexCount, const b2Color &color)
 {
-	sf::ConvexShape polygon(vertexCount);
-	for (int i = 0; i < vertexCount; i++)
+	// convex, so a fan
+	sf::Color fill = SFMLDebugDraw::GLColorToSFML(color, 60);
+	for (int i = 1; i < vertexCount - 1; i++)
 	{
-		//polygon.setPoint(i, SFMLDraw::B2VecToSFVec(vertices[i]));
-		sf::Vector2f transformedVec = SFMLDebugDraw::B2VecToSFVec(vertices[i]);
-		polygon.setPoint(i, sf::Vector2f(std::floor(transformedVec.x), std::floor(
-				transformedVec.y))); // flooring the coords to fix distorted lines on flat surfaces
-	} // they still show up though.. but less frequently
-	polygon.setOutlineThickness(-1.f);
-	polygon.setFillColor(SFMLDebugDraw::GLColorToSFML(color, 60));
-	polygon.setOutlineColor(SFMLDebugDraw::GLColorToSFML(color));
-
-	m_window->draw(polygon);
+		m_triangles.append(sf::Vertex(FlooredVec(vertices[0]), fill));
+		m_triangles.append(sf::Vertex(FlooredVec(vertices[i]), fill));
+		m_triangles.append(sf::Vertex(FlooredVec(vertices[i + 1]), fill));
+	}
+
+	DrawPolygon(vertices, vertexCount, color);
 }
 
 void SFMLDebugDraw::DrawCircle(const b2Vec2 &center, float32 radius, const b2Color &color)
 {
-	sf::CircleShape circle(radius * sfdd::SCALE);
-	circle.setOrigin(radius * sfdd::SCALE, radius * sfdd::SCALE);
-	circle.setPosition(SFMLDebugDraw::B2VecToSFVec(center));
-	circle.setFillColor(sf::Color::Transparent);
-	circle.setOutlineThickness(-1.f);
-	circle.setOutlineColor(SFMLDebugDraw::GLColorToSFML(color));
-
-	m_window->draw(circle);
+	AppendCircle(center, radius, SFMLDebugDraw::GLColorToSFML(color), false);
 }
 
 void SFMLDebugDraw::DrawSolidCircle(const b2Vec2 &center, float32 radius, const b2Vec2 &axis, const b2Color &color)
 {
-	sf::CircleShape circle(radius * sfdd::SCALE);
-	circle.setOrigin(radius * sfdd::SCALE, radius * sfdd::SCALE);
-	circle.setPosition(SFMLDebugDraw::B2VecToSFVec(center));
-	circle.setFillColor(SFMLDebugDraw::GLColorToSFML(color, 60));
-	circle.setOutlineThickness(1.f);
-	circle.setOutlineColor(SFMLDebugDraw::GLColorToSFML(color));
+	sf::Color outline = SFMLDebugDraw::GLColorToSFML(color);
+	AppendCircle(center, radius, outline, true);
 
 	b2Vec2 endPoint = center + radius * axis;
-	sf::Vertex line[2] =
-			{
-					sf::Vertex(SFMLDebugDraw::B2VecToSFVec(center), SFMLDebugDraw::GLColorToSFML(color)),
-					sf::Vertex(SFMLDebugDraw::B2VecToSFVec(endPoint), SFMLDebugDraw::GLColorToSFML(color)),
-			};
-
-	m_window->draw(circle);
-	m_window->draw(line, 2, sf::Lines);
+	AppendLine(SFMLDebugDraw::B2VecToSFVec(center), SFMLDebugDraw::B2VecToSFVec(endPoint), outline);
 }
 
 void SFMLDebugDraw::DrawSegment(const b2Vec2 &p1, const b2Vec2 &p2, const b2Color &color)
 {
-	sf::Vertex line[] =
-			{
-					sf::Vertex(SFMLDebugDraw::B2VecToSFVec(p1), SFMLDebugDraw::GLColorToSFML(color)),
-					sf::Vertex(SFMLDebugDraw::B2VecToSFVec(p2), SFMLDebugDraw::GLColorToSFML(color))
-			};
-
-	m_window->draw(line, 2, sf::Lines);
+	AppendLine(SFMLDebugDraw::B2VecToSFVec(p1), SFMLDebugDraw::B2VecToSFVec(p2), SFMLDebugDraw::GLColorToSFML(color));
 }
 
 void SFMLDebugDraw::DrawTransform(const b2Transform &xf)
 {
 	float lineLength = 0.4f;
 
-	/*b2Vec2 xAxis(b2Vec2(xf.p.x + (lineLength * xf.q.c), xf.p.y + (lineLength * xf.q.s)));*/
-	b2Vec2 xAxis = xf.p + lineLength * xf.q.GetXAxis();
-	sf::Vertex redLine[] =
-			{
-					sf::Vertex(SFMLDebugDraw::B2VecToSFVec(xf.p), sf::Color::Red),
-					sf::Vertex(SFMLDebugDraw::B2VecToSFVec(xAxis), sf::Color::Red)
-			};
-
 	// You might notice that the ordinate(Y axis) points downward unlike the one in Box2D testbed
 	// That's because the ordinate in SFML coordinate system points downward while the OpenGL(testbed) points upward
-	/*b2Vec2 yAxis(b2Vec2(xf.p.x + (lineLength * -xf.q.s), xf.p.y + (lineLength * xf.q.c)));*/
+	b2Vec2 xAxis = xf.p + lineLength * xf.q.GetXAxis();
 	b2Vec2 yAxis = xf.p + lineLength * xf.q.GetYAxis();
-	sf::Vertex greenLine[] =
+
+	AppendLine(SFMLDebugDraw::B2VecToSFVec(xf.p), SFMLDebugDraw::B2VecToSFVec(xAxis), sf::Color::Red);
+	AppendLine(SFMLDebugDraw::B2VecToSFVec(xf.p), SFMLDebugDraw::B2VecToSFVec(yAxis), sf::Color::Green);
+}
+
+void SFMLDebugDraw::DrawVector(const sf::Vector2f &from, const sf::Vector2f &vector, const sf::Color &color)
+{
+	AppendLine(from, from + vector, color);
+}
+
+void SFMLDebugDraw::DrawFixtures(b2World &world, const b2AABB &region)
+{
+	struct FixtureQuery : public b2QueryCallback
+	{
+		SFMLDebugDraw *draw;
+		std::unordered_set<b2Fixture *> drawn; // chains are reported once per edge
+
+		FixtureQuery(SFMLDebugDraw *draw) : draw(draw)
+		{
+		}
+
+		bool ReportFixture(b2Fixture *fixture) override
+		{
+			if (!drawn.insert(fixture).second)
+				return true;
+
+			const b2Body *body = fixture->GetBody();
+			const b2Transform &xf = body->GetTransform();
+
+			// the same colours as b2World::DrawDebugData
+			b2Color color(0.9f, 0.7f, 0.7f);
+			if (body->GetType() == b2_staticBody)
+				color = b2Color(0.5f, 0.9f, 0.5f);
+			else if (!body->IsAwake())
+				color = b2Color(0.6f, 0.6f, 0.6f);
+
+			b2Shape *shape = fixture->GetShape();
+			switch (shape->GetType())
 			{
-					sf::Vertex(SFMLDebugDraw::B2VecToSFVec(xf.p), sf::Color::Green),
-					sf::Vertex(SFMLDebugDraw::B2VecToSFVec(yAxis), sf::Color::Green)
-			};
+				case b2Shape::e_circle:
+				{
+					b2CircleShape *circle = static_cast<b2CircleShape *>(shape);
+					draw->DrawSolidCircle(b2Mul(xf, circle->m_p), circle->m_radius, xf.q.GetXAxis(), color);
+					break;
+				}
+
+				case b2Shape::e_edge:
+				{
+					b2EdgeShape *edge = static_cast<b2EdgeShape *>(shape);
+					draw->DrawSegment(b2Mul(xf, edge->m_vertex1), b2Mul(xf, edge->m_vertex2), color);
+					break;
+				}
+
+				case b2Shape::e_chain:
+				{
+					b2ChainShape *chain = static_cast<b2ChainShape *>(shape);
+					for (int32 i = 0; i < chain->m_count - 1; i++)
+						draw->DrawSegment(b2Mul(xf, chain->m_vertices[i]), b2Mul(xf, chain->m_vertices[i + 1]), color);
+					break;
+				}
+
+				case b2Shape::e_polygon:
+				{
+					b2PolygonShape *poly = static_cast<b2PolygonShape *>(shape);
+					b2Vec2 vertices[b2_maxPolygonVertices];
+					for (int32 i = 0; i < poly->m_count; i++)
+						vertices[i] = b2Mul(xf, poly->m_vertices[i]);
+					draw->DrawSolidPolygon(vertices, poly->m_count, color);
+					break;
+				}
+
+				default:
+					break;
+			}
+
+			return true;
+		}
+	} query(this);
+
+	world.QueryAABB(&query, region);
+}
+
+void SFMLDebugDraw::Flush()
+{
+	if (m_triangles.getVertexCount() != 0)
+		m_window->draw(m_triangles);
+	if (m_lines.getVertexCount() != 0)
+		m_window->draw(m_lines);
+
+	m_triangles.clear();
+	m_lines.clear();
+}
 
-	m_window->draw(redLine, 2, sf::Lines);
-	m_window->draw(greenLine, 2, sf::Lines);
+std::size_t SFMLDebugDraw::GetLineVertexCount() const
+{
+	return m_lines.getVertexCount();
+}
+
+std::size_t SFMLDebugDraw::GetTriangleVertexCount() const
+{
+	return m_triangles.getVertexCount();
 }
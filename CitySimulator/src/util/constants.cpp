@@ -1,3 +1,8 @@
+#include <cmath>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "constants.hpp"
 #include "utils.hpp"
 
@@ -9,6 +14,8 @@ namespace Constants
 	const int tileSize(32);
 	const float tileSizef(tileSize);
 	const int tilesetResolution(16);
+	const int chunkSize(64); // tiles
+	const int maxLightLevel(15); // also the furthest light spreads, in tiles
 
 	const float scale(tileSizef / tilesetResolution);
 	const float tileScale(tileSizef * scale);
@@ -56,6 +63,60 @@ DirectionType Direction::fromAngle(double degrees)
 }
 
 
+void Direction::fromVectors(const float *x, const float *y, std::size_t count, unsigned char *out)
+{
+	std::size_t i = 0;
+
+#ifdef __SSE2__
+	// four at once, by the same comparisons as below
+	const __m128 signMask = _mm_set1_ps(-0.f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128i north = _mm_set1_epi32(DIRECTION_NORTH);
+	const __m128i east = _mm_set1_epi32(DIRECTION_EAST);
+	const __m128i south = _mm_set1_epi32(DIRECTION_SOUTH);
+	const __m128i west = _mm_set1_epi32(DIRECTION_WEST);
+
+	auto select = [](__m128 mask, __m128i a, __m128i b) -> __m128i
+	{
+		__m128i m = _mm_castps_si128(mask);
+		return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b));
+	};
+
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 vx = _mm_loadu_ps(x + i);
+		__m128 vy = _mm_loadu_ps(y + i);
+		__m128 absX = _mm_andnot_ps(signMask, vx);
+		__m128 absY = _mm_andnot_ps(signMask, vy);
+
+		__m128 vertical = _mm_or_ps(_mm_cmpgt_ps(absY, absX),
+		                            _mm_and_ps(_mm_cmpeq_ps(absY, absX), _mm_cmpgt_ps(vx, zero)));
+		__m128i verticalDir = select(_mm_cmpgt_ps(vy, zero), south, north);
+		__m128i horizontalDir = select(_mm_cmplt_ps(vx, zero), west, east);
+		__m128i dirs = select(vertical, verticalDir, horizontalDir);
+
+		// narrowed to a byte each
+		dirs = _mm_packs_epi32(dirs, dirs);
+		dirs = _mm_packus_epi16(dirs, dirs);
+		int packed = _mm_cvtsi128_si32(dirs);
+		std::memcpy(out + i, &packed, 4);
+	}
+#endif
+
+	for (; i < count; ++i)
+	{
+		float absX = std::fabs(x[i]);
+		float absY = std::fabs(y[i]);
+
+		// diagonals round away from west, as fromAngle does
+		bool vertical = absY > absX || (absY == absX && x[i] > 0.f);
+		unsigned char verticalDir = y[i] > 0.f ? DIRECTION_SOUTH : DIRECTION_NORTH;
+		unsigned char horizontalDir = x[i] < 0.f ? DIRECTION_WEST : DIRECTION_EAST;
+
+		out[i] = vertical ? verticalDir : horizontalDir;
+	}
+}
+
 DirectionType Direction::parseString(const std::string &s)
 {
 	if (s == "N" || s == "n")
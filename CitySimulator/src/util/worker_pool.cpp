@@ -0,0 +1,63 @@
+#include <algorithm>
+#include "worker_pool.hpp"
+
+WorkerPool::WorkerPool(std::size_t workerCount) : workerCount(workerCount), stopping(false)
+{
+	if (this->workerCount == 0)
+		this->workerCount = std::max(1u, std::thread::hardware_concurrency());
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	jobAdded.notify_all();
+
+	for (std::thread &worker : workers)
+		worker.join();
+}
+
+void WorkerPool::enqueue(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(std::move(job));
+
+		// started on first use, as most pools are never used
+		if (workers.empty())
+			for (std::size_t i = 0; i < workerCount; ++i)
+				workers.emplace_back(&WorkerPool::work, this);
+	}
+	jobAdded.notify_one();
+}
+
+std::size_t WorkerPool::getWorkerCount() const
+{
+	return workerCount;
+}
+
+void WorkerPool::work()
+{
+	while (true)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobAdded.wait(lock, [this]()
+			{
+				return stopping || !jobs.empty();
+			});
+
+			// only once everything queued has run
+			if (jobs.empty())
+				return;
+
+			task = std::move(jobs.front());
+			jobs.pop_front();
+		}
+
+		task();
+	}
+}
@@ -23,10 +23,13 @@ Building::Building(const sf::IntRect &tileBounds, BuildingID id,
 
 void Building::discoverWindows()
 {
+	windows.clear();
+
 	WindowID id(0);
-	for (int x = bounds.left; x <= bounds.left + bounds.width; ++x)
+	sf::Vector2i worldSize = outsideWorld->getTileSize();
+	for (int x = bounds.left; x <= std::min(bounds.left + bounds.width, worldSize.x - 1); ++x)
 	{
-		for (int y = bounds.top; y <= bounds.top + bounds.height; ++y)
+		for (int y = bounds.top; y <= std::min(bounds.top + bounds.height, worldSize.y - 1); ++y)
 		{
 			sf::Vector2i tile(x, y);
 			BlockType b = outsideWorld->getTerrain()->getBlockType(tile, LAYER_OVERTERRAIN);
@@ -120,3 +123,8 @@ World *Building::getInsideWorld() const
 {
 	return insideWorld;
 }
+
+const sf::IntRect &Building::getBounds() const
+{
+	return bounds;
+}
@@ -1,11 +1,72 @@
+#include <algorithm>
 #include "world.hpp"
+#include <sstream>
+#include "animation.hpp"
 #include "service/locator.hpp"
+#include "service/config_service.hpp"
 
 WorldService::WorldService(const std::string &mainWorldPath, const std::string &tilesetPath)
-		: tileset(tilesetPath), mainWorldName(mainWorldPath), entityTransferListener(this)
+		: tileset(tilesetPath), mainWorldName(mainWorldPath), timeOfDay(0.f), entityTransferListener(this),
+		  terrainCollisionListener(this), prefetcher(this)
 {
 }
 
+void WorldService::loadTileAnimations()
+{
+	ConfigService *config = Locator::locate<ConfigService>(false);
+	if (config == nullptr)
+		return;
+
+	std::vector<std::map<std::string, std::string>> animations;
+	try
+	{
+		config->getMapList("world.animated-tiles", animations);
+	}
+	catch (boost::property_tree::ptree_bad_path &)
+	{
+		return;
+	}
+
+	for (auto &animation : animations)
+	{
+		BlockType blockType = static_cast<BlockType>(Utils::stringToInt(animation["block"]));
+
+		std::vector<int> frames;
+		std::istringstream frameList(animation["frames"]);
+		std::string frame;
+		while (frameList >> frame)
+			frames.push_back(Utils::stringToInt(frame));
+
+		float frameDuration = animation.count("frame-duration") == 0 ? 0.5f : std::stof(animation["frame-duration"]);
+		tileset.addAnimation(blockType, frames, frameDuration);
+	}
+
+	Logger::logDebug(format("Loaded %1% animated tile(s)", _str(tileset.getAnimationCount())));
+}
+
+void WorldService::loadLightEmitters()
+{
+	std::vector<std::map<std::string, std::string>> emitters;
+
+	ConfigService *config = Locator::locate<ConfigService>(false);
+	try
+	{
+		if (config != nullptr)
+			config->getMapList("world.lighting.emitters", emitters);
+	}
+	catch (boost::property_tree::ptree_bad_path &)
+	{
+	}
+
+	for (auto &emitter : emitters)
+	{
+		BlockType blockType = static_cast<BlockType>(Utils::stringToInt(emitter["block"]));
+		tileset.setLightEmission(blockType, Utils::stringToInt(emitter["intensity"]));
+	}
+
+	Logger::logDebug(format("Loaded %1% light source(s)", _str(emitters.size())));
+}
+
 void WorldService::onEnable()
 {
 	Logger::logDebug("Starting to load worlds");
@@ -17,11 +78,13 @@ void WorldService::onEnable()
 
 	// generate tileset
 	tileset.load();
+	loadTileAnimations();
+	loadLightEmitters();
 	tileset.convertToTexture(loader.flippedTileGIDs);
 
 	// load terrain
 	for (auto &pair : terrainCache)
-		pair.second.applyTiles(tileset);
+		pair.second.applyTiles(tileset, workers);
 
 	// transfer loaded worlds
 	for (auto &lwPair : loader.loadedWorlds)
@@ -50,20 +113,35 @@ void WorldService::onEnable()
 
 	}
 
-	// load collisions
+	// merge collision rects once per terrain
 	for (auto &pair : terrainCache)
 		pair.second.loadBlockData();
 
+	// only the main world is instantiated up front, the rest on demand
+	instantiateWorld(getMainWorld()->getID());
+	prefetcher.discoverDoors(connectionLookup);
+
 	Logger::popIndent();
 
 	// register listener
 	entityTransferListener.identifier = "world entity transfer listener";
 	Locator::locate<EventService>()->registerListener(
 			&entityTransferListener, EVENT_HUMAN_SWITCH_WORLD);
+
+	// rebuild derived state after terrain edits
+	terrainRenderListener.identifier = "terrain render chunk listener";
+	terrainCollisionListener.identifier = "terrain collision chunk listener";
+	buildingIndexListener.identifier = "building window index listener";
+	registerTerrainListener(&terrainRenderListener);
+	registerTerrainListener(&terrainCollisionListener);
+	registerTerrainListener(&buildingIndexListener);
 }
 
 void WorldService::onDisable()
 {
+	prefetcher.cancelAll();
+	pendingTransfers.clear();
+
 	Logger::logDebug("Deleting all loaded worlds");
 	for (auto &pair : worlds)
 		delete pair.second;
@@ -110,14 +188,152 @@ bool WorldService::getDoorDimensions(const Location &door, sf::Vector2f &out)
 	return true;
 }
 
+World *WorldService::instantiateWorld(WorldID id)
+{
+	World *world = getWorld(id);
+	if (world == nullptr)
+		error("Cannot instantiate unknown world %1%", _str(id));
+
+	// finish a prefetch if there is one in progress
+	CollisionMap *prefetched = prefetcher.take(id);
+	if (prefetched != nullptr)
+		world->load(prefetched);
+	else
+		world->load();
+
+	activeWorlds[id] = 0.f;
+	return world;
+}
+
+CollisionRebuildCost WorldService::rebuildRegion(WorldID id, const sf::IntRect &tiles)
+{
+	World *world = getWorld(id);
+	if (world == nullptr)
+		error("Cannot rebuild region of unknown world %1%", _str(id));
+
+	sf::Clock clock;
+	WorldTerrain *terrain = world->getTerrain();
+
+	// prefetch workers read the collision rects being remeshed
+	prefetcher.cancelTerrain(terrain);
+	terrain->remeshRegion(tiles);
+
+	// every instance sharing this terrain
+	CollisionRebuildCost total;
+	for (auto &pair : activeWorlds)
+	{
+		World *instance = getWorld(pair.first);
+		if (instance->getTerrain() != terrain || !instance->isLoaded())
+			continue;
+
+		CollisionRebuildCost cost = instance->getCollisionMap()->rebuildRegion(tiles);
+		total.chunks += cost.chunks;
+		total.fixturesRemoved += cost.fixturesRemoved;
+		total.fixturesAdded += cost.fixturesAdded;
+	}
+
+	total.milliseconds = clock.getElapsedTime().asMicroseconds() / 1000.f;
+
+	Logger::logDebug(format("Rebuilt %1% chunk(s) of world %2% in %3%ms", 
+	                        _str(total.chunks), _str(id), _str(total.milliseconds)) +
+	                 format(", replacing %1% fixture(s) with %2%", 
+	                        _str(total.fixturesRemoved), _str(total.fixturesAdded)));
+	return total;
+}
+
+void WorldService::prefetchWorld(WorldID id)
+{
+	prefetcher.prefetch(id);
+}
+
 void WorldService::tickActiveWorlds(float delta)
 {
-	for (auto &pair : worlds)
+	prefetcher.tick();
+
+	float dayLength = Config::getFloat("world.lighting.day-length", 600.f);
+	timeOfDay = fmod(timeOfDay + delta, dayLength);
+
+	float idleTimeout = Config::getFloat("world.interior-idle-timeout", 30.f);
+
+	CameraService *cs = Locator::locate<CameraService>(false);
+	World *cameraWorld = cs == nullptr ? nullptr : cs->getCurrentWorld();
+
+	// in world ID order
+	std::vector<World *> stepping;
+
+	auto it = activeWorlds.begin();
+	while (it != activeWorlds.end())
 	{
-		World *world = pair.second;
+		World *world = getWorld(it->first);
+		float &idleTime = it->second;
+
 		if (!world->isEmpty())
-			world->tick(delta);
+		{
+			idleTime = 0.f;
+			world->prepareTick(delta);
+			stepping.push_back(world);
+			++it;
+			continue;
+		}
+
+		// keep the outside world and whatever the camera is looking at
+		idleTime += delta;
+		if (idleTime < idleTimeout || world->isOutside() || world == cameraWorld)
+		{
+			++it;
+			continue;
+		}
+
+		world->unload();
+		it = activeWorlds.erase(it);
+	}
+
+	stepWorlds(stepping, delta);
+
+	// merge cross-world side effects deterministically
+	for (World *world : stepping)
+		world->finishTick();
+
+	processTransfers();
+}
+
+float WorldService::getAmbientLight() const
+{
+	float dayLength = Config::getFloat("world.lighting.day-length", 600.f);
+	float night = Config::getFloat("world.lighting.night-light", 0.25f);
+
+	// brightest at noon, darkest at midnight
+	float daylight = 0.5f + 0.5f * (float) cos(timeOfDay / dayLength * 2 * Math::PI);
+	return night + (1.f - night) * daylight;
+}
+
+void WorldService::stepWorlds(const std::vector<World *> &stepping, float delta)
+{
+	if (stepping.empty())
+		return;
+
+	if (stepping.size() == 1 || !Config::getBool("world.parallel-step", true))
+	{
+		for (World *world : stepping)
+			world->step(delta);
+		return;
+	}
+
+	// every world has its own b2World, so they can step independently
+	std::vector<std::future<void>> steps;
+	for (std::size_t i = 1; i < stepping.size(); ++i)
+	{
+		World *world = stepping[i];
+		steps.push_back(workers.submit([world, delta]()
+		{
+			world->step(delta);
+		}));
 	}
+
+	stepping.front()->step(delta);
+
+	for (std::future<void> &step : steps)
+		step.get();
 }
 
 WorldService::EntityTransferListener::EntityTransferListener(WorldService *ws) : ws(ws)
@@ -168,30 +384,62 @@ void adjustSpawnOffset(sf::Vector2f &spawnPos, sf::Vector2f &directionOut,
 
 void WorldService::EntityTransferListener::onEvent(const Event &event)
 {
-	World *newWorld = ws->getWorld(event.humanSwitchWorld.newWorld);
-	b2World *newBWorld = newWorld->getBox2DWorld();
-	// todo nullptr should never be returned, throw exception instead
+	// only the first door touched this tick counts
+	for (const PendingTransfer &transfer : ws->pendingTransfers)
+		if (transfer.event.entityID == event.entityID)
+			return;
 
 	EntityService *es = Locator::locate<EntityService>();
 	PhysicsComponent *phys = es->getComponent<PhysicsComponent>(event.entityID, COMPONENT_PHYSICS); // todo never return null
-	b2World *oldBWorld = phys->bWorld;
+
+	ws->pendingTransfers.emplace_back(event, phys->world);
+}
+
+void WorldService::processTransfers()
+{
+	if (pendingTransfers.empty())
+		return;
+
+	// batch by world pair, so each target is instantiated once
+	std::stable_sort(pendingTransfers.begin(), pendingTransfers.end(),
+			[](const PendingTransfer &a, const PendingTransfer &b)
+			{
+				WorldID aTarget = a.event.humanSwitchWorld.newWorld;
+				WorldID bTarget = b.event.humanSwitchWorld.newWorld;
+				return a.from < b.from || (a.from == b.from && aTarget < bTarget);
+			});
+
+	World *newWorld = nullptr;
+	for (const PendingTransfer &transfer : pendingTransfers)
+	{
+		WorldID target = transfer.event.humanSwitchWorld.newWorld;
+		if (newWorld == nullptr || newWorld->getID() != target)
+			newWorld = instantiateWorld(target);
+
+		transferEntity(transfer.event, newWorld);
+	}
+
+	Logger::logDebuggiest(format("Transferred %1% entities between worlds", _str(pendingTransfers.size())));
+	pendingTransfers.clear();
+}
+
+void WorldService::transferEntity(const Event &event, World *newWorld)
+{
+	EntityService *es = Locator::locate<EntityService>();
+	if (!es->hasComponent(event.entityID, COMPONENT_PHYSICS))
+		return;
+
+	PhysicsComponent *phys = es->getComponent<PhysicsComponent>(event.entityID, COMPONENT_PHYSICS);
 
 	sf::Vector2f newPosition, newDirection;
 	newPosition.x = event.humanSwitchWorld.spawnX;
 	newPosition.y = event.humanSwitchWorld.spawnY;
-	adjustSpawnOffset(newPosition, newDirection, phys, newWorld, ws);
-
-	// clone body and add to new world
-	b2Body *oldBody = phys->body;
-	b2Body *newBody = es->createBody(newBWorld, oldBody, newPosition);
+	adjustSpawnOffset(newPosition, newDirection, phys, newWorld, this);
 
-	// remove from old world
-	oldBWorld->DestroyBody(oldBody);
-
-	// update component
-	phys->body = newBody;
-	phys->bWorld = newBWorld;
-	phys->world = newWorld->getID();
+	// the old body is kept for the next entity heading the other way,
+	// and a parked one reused in the new world
+	es->removeFromWorld(event.entityID);
+	es->placeInWorld(event.entityID, newWorld, newPosition);
 	phys->setVelocity(newDirection);
 
 	// camera target
@@ -200,7 +448,7 @@ void WorldService::EntityTransferListener::onEvent(const Event &event)
 	{
 		Event e;
 		e.type = EVENT_CAMERA_SWITCH_WORLD;
-		e.cameraSwitchWorld.newWorld = event.humanSwitchWorld.newWorld;
+		e.cameraSwitchWorld.newWorld = newWorld->getID();
 		e.cameraSwitchWorld.centreX = (int) newPosition.x;
 		e.cameraSwitchWorld.centreY = (int) newPosition.y;
 
@@ -209,7 +457,7 @@ void WorldService::EntityTransferListener::onEvent(const Event &event)
 }
 
 World::World(WorldID id, const std::string &name, bool outside) 
-: id(id), name(name), outside(outside)
+: id(id), name(name), outside(outside), terrain(nullptr)
 {
 	transform.scale(Constants::tileSizef, Constants::tileSizef);
 	if (outside)
@@ -230,7 +478,7 @@ WorldTerrain *World::getTerrain()
 
 CollisionMap *World::getCollisionMap() const
 {
-	return terrain == nullptr ? nullptr : terrain->getCollisionMap();
+	return collisionMap.get();
 }
 
 ConnectionMap *World::getConnectionMap()
@@ -255,7 +503,10 @@ DomesticConnectionMap *World::getDomesticConnectionMap()
 
 b2World *World::getBox2DWorld() const
 {
-	return &getCollisionMap()->world;
+	if (!isLoaded())
+		error("Cannot get Box2D world of unloaded world %1%", _str(id));
+
+	return &collisionMap->world;
 }
 
 sf::Vector2i World::getPixelSize() const
@@ -290,13 +541,80 @@ bool World::isOutside() const
 
 bool World::isEmpty()
 {
-	return getBox2DWorld()->GetBodyCount() == 1; // just block collision body
+	// just terrain and parked bodies
+	return !isLoaded() || (getBox2DWorld()->GetBodyCount() == 
+		collisionMap->getStaticBodyCount() + collisionMap->getParkedBodyCount() &&
+		collisionMap->getAgentGrid()->getAgentCount() == 0);
 }
 
-void World::tick(float delta)
+bool World::isLoaded() const
+{
+	return collisionMap != nullptr;
+}
+
+void World::load()
+{
+	if (isLoaded())
+		return;
+
+	if (terrain == nullptr)
+		error("Cannot load world %1% without a terrain", _str(id));
+
+	Logger::logDebuggier(format("Instantiating world %1% ('%2%')", _str(id), name));
+
+	collisionMap.reset(new CollisionMap(this));
+	collisionMap->load();
+}
+
+void World::load(CollisionMap *prefetched)
+{
+	if (isLoaded())
+	{
+		delete prefetched;
+		return;
+	}
+
+	Logger::logDebuggier(format("Instantiating world %1% ('%2%') from prefetch", _str(id), name));
+
+	collisionMap.reset(prefetched);
+	collisionMap->finishLoading();
+}
+
+void World::unload()
+{
+	if (!isLoaded())
+		return;
+
+	if (!isEmpty())
+		error("Cannot unload world %1% as it still has entities in it", _str(id));
+
+	Logger::logDebuggier(format("Unloading world %1% ('%2%')", _str(id), name));
+
+	collisionMap.reset();
+}
+
+void World::prepareTick(float delta)
+{
+	collisionMap->streamChunks(delta);
+}
+
+void World::step(float delta)
 {
 	// todo fixed time step
 	getBox2DWorld()->Step(delta, 6, 2);
+	collisionMap->stepAgents(delta);
+}
+
+void World::finishTick()
+{
+	collisionMap->dispatchDoorContacts();
+}
+
+void World::tick(float delta)
+{
+	prepareTick(delta);
+	step(delta);
+	finishTick();
 }
 
 // todo move to world_rendering
@@ -304,17 +622,40 @@ void World::draw(sf::RenderTarget &target, sf::RenderStates states) const
 {
 	states.transform *= transform;
 
-	// terrain
-	terrain->render(target, states, false);
+	// visible region in tiles
+	const sf::View &view = target.getView();
+	sf::FloatRect visibleTiles = states.transform.getInverse().transformRect(
+			sf::FloatRect(view.getCenter() - view.getSize() / 2.f, view.getSize()));
 
-	// entities
-	Locator::locate<EntityService>()->renderSystems(id);
+	// zoomed so far out that tiles are only a few pixels across
+	float tilePixels = target.getSize().x / visibleTiles.width;
+	if (tilePixels < Config::getFloat("world.lod.overview-tile-pixels", 4.f))
+	{
+		terrain->renderOverview(target, states, visibleTiles);
+		Locator::locate<EntityService>()->renderSystems(id, visibleTiles);
+	}
+
+	else
+	{
+		terrain->streamChunks(visibleTiles);
+		terrain->animateTiles(Animator::getClock(), visibleTiles);
 
-	// overterrain
-	terrain->render(target, states, true);
+		// inside is always lit
+		float ambient = isOutside() ? Locator::locate<WorldService>()->getAmbientLight() : 1.f;
+		terrain->updateLighting(ambient, visibleTiles);
+
+		// terrain
+		terrain->render(target, states, visibleTiles, false);
+
+		// entities
+		Locator::locate<EntityService>()->renderSystems(id, visibleTiles);
+
+		// overterrain
+		terrain->render(target, states, visibleTiles, true);
+	}
 
 	// box2d debug
-	if (Config::getBool("debug.render-physics"))
-		getBox2DWorld()->DrawDebugData();
+	if (Config::getBool("debug.render-physics") && isLoaded())
+		collisionMap->renderDebug(visibleTiles);
 
 }
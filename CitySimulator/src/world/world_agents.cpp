@@ -0,0 +1,414 @@
+#include <algorithm>
+#include <cmath>
+#include "world.hpp"
+
+const unsigned char TILE_SOLID = 1 << 0;
+const unsigned char TILE_DOOR = 1 << 1;
+
+/**
+ * @return The offset of the centre of an agent's feet from its position,
+ * matching the box2d footprint
+ */
+static float getFootOffset()
+{
+	return Constants::entityScalef / 2 * 0.75f;
+}
+
+static sf::Vector2i getFootTile(float x, float y)
+{
+	return sf::Vector2i((int) floor(x), (int) floor(y + getFootOffset()));
+}
+
+template<class T>
+static void removeSwapped(std::vector<T> &v, int index)
+{
+	v[index] = v.back();
+	v.pop_back();
+}
+
+AgentGrid::AgentGrid(World *container) : BaseWorld(container)
+{
+}
+
+AgentID AgentGrid::addAgent(EntityID entity, const sf::Vector2f &pos, bool entityCollision)
+{
+	if (tileFlags.empty())
+		cacheTiles();
+
+	AgentID agent;
+	if (freeHandles.empty())
+	{
+		agent = indices.size();
+		indices.push_back(-1);
+	}
+	else
+	{
+		agent = freeHandles.back();
+		freeHandles.pop_back();
+	}
+
+	indices[agent] = posX.size();
+	handles.push_back(agent);
+	hashed = false;
+
+	posX.push_back(pos.x);
+	posY.push_back(pos.y);
+	velX.push_back(0.f);
+	velY.push_back(0.f);
+	damping.push_back(0.f);
+	this->entityCollision.push_back(entityCollision);
+	entities.push_back(entity);
+
+	// not entering a door it spawned on
+	lastTiles.push_back(getFootTile(pos.x, pos.y));
+
+	return agent;
+}
+
+void AgentGrid::removeAgent(AgentID agent)
+{
+	int index = getIndex(agent);
+
+	// move the last agent into the gap
+	indices[handles.back()] = index;
+	removeSwapped(handles, index);
+	removeSwapped(posX, index);
+	removeSwapped(posY, index);
+	removeSwapped(velX, index);
+	removeSwapped(velY, index);
+	removeSwapped(damping, index);
+	removeSwapped(entityCollision, index);
+	removeSwapped(entities, index);
+	removeSwapped(lastTiles, index);
+
+	indices[agent] = -1;
+	freeHandles.push_back(agent);
+	hashed = false;
+}
+
+sf::Vector2f AgentGrid::getPosition(AgentID agent) const
+{
+	int index = getIndex(agent);
+	return sf::Vector2f(posX[index], posY[index]);
+}
+
+sf::Vector2f AgentGrid::getVelocity(AgentID agent) const
+{
+	int index = getIndex(agent);
+	return sf::Vector2f(velX[index], velY[index]);
+}
+
+void AgentGrid::setVelocity(AgentID agent, const sf::Vector2f &velocity)
+{
+	int index = getIndex(agent);
+	velX[index] = velocity.x;
+	velY[index] = velocity.y;
+}
+
+void AgentGrid::setDamping(AgentID agent, float damping)
+{
+	this->damping[getIndex(agent)] = damping;
+}
+
+float AgentGrid::getRadius() const
+{
+	// about the height of the box2d footprint
+	return Constants::entityScalef / 2 * 0.5f;
+}
+
+int AgentGrid::getAgentCount() const
+{
+	return posX.size();
+}
+
+int AgentGrid::getIndex(AgentID agent) const
+{
+	if (agent < 0 || agent >= (int) indices.size() || indices[agent] == -1)
+		error("Invalid agent %1%", _str(agent));
+
+	return indices[agent];
+}
+
+int AgentGrid::getBucket(int cellX, int cellY) const
+{
+	unsigned int hash = ((unsigned int) cellX * 73856093u) ^ ((unsigned int) cellY * 19349663u);
+	return hash & (bucketHeads.size() - 1);
+}
+
+void AgentGrid::cacheTiles()
+{
+	sf::Vector2i size = container->getTileSize();
+	tileFlags.assign(size.x * size.y, 0);
+	refreshTiles({0, 0, size.x, size.y});
+}
+
+void AgentGrid::refreshTiles(const sf::IntRect &tiles)
+{
+	if (tileFlags.empty())
+		return;
+
+	WorldTerrain *terrain = container->getTerrain();
+	sf::Vector2i size = container->getTileSize();
+
+	sf::IntRect region;
+	if (!tiles.intersects({0, 0, size.x, size.y}, region))
+		return;
+
+	for (int y = region.top; y < region.top + region.height; ++y)
+	{
+		for (int x = region.left; x < region.left + region.width; ++x)
+		{
+			BlockType blockType = terrain->getBlockType({x, y});
+
+			unsigned char flags = 0;
+			if (isInteractable(blockType))
+				flags |= TILE_DOOR;
+			else if (isCollidable(blockType))
+				flags |= TILE_SOLID;
+
+			tileFlags[x + y * size.x] = flags;
+		}
+	}
+
+	// objects block every tile they overlap, ignoring rotation
+	std::vector<int> chunks;
+	terrain->getChunksInRegion(region, chunks);
+	for (int chunk : chunks)
+	{
+		for (const CollisionRect &object : terrain->getObjectCollisionRects(chunk))
+		{
+			sf::FloatRect rect = Utils::scaleToBox2D(object.rect);
+			int right = std::min(region.left + region.width, (int) ceil(rect.left + rect.width));
+			int bottom = std::min(region.top + region.height, (int) ceil(rect.top + rect.height));
+
+			for (int y = std::max(region.top, (int) floor(rect.top)); y < bottom; ++y)
+				for (int x = std::max(region.left, (int) floor(rect.left)); x < right; ++x)
+					tileFlags[x + y * size.x] |= TILE_SOLID;
+		}
+	}
+}
+
+void AgentGrid::step(float delta, std::vector<std::pair<EntityID, sf::Vector2i>> &enteredDoors)
+{
+	const int count = getAgentCount();
+	if (count == 0)
+		return;
+
+	// integrate in the same order as box2d: damp, then move
+	float *px = posX.data();
+	float *py = posY.data();
+	float *vx = velX.data();
+	float *vy = velY.data();
+	const float *d = damping.data();
+	for (int i = 0; i < count; ++i)
+	{
+		float scale = 1.f / (1.f + delta * d[i]);
+		vx[i] *= scale;
+		vy[i] *= scale;
+		px[i] += vx[i] * delta;
+		py[i] += vy[i] * delta;
+	}
+
+	hashAgents();
+	separateAgents();
+
+	// tiles last, so agents never end up pushed into walls
+	for (int i = 0; i < count; ++i)
+		collideWithTiles(i);
+
+	sf::Vector2i size = container->getTileSize();
+	for (int i = 0; i < count; ++i)
+	{
+		sf::Vector2i tile = getFootTile(posX[i], posY[i]);
+		if (tile == lastTiles[i])
+			continue;
+
+		lastTiles[i] = tile;
+		if (tile.x >= 0 && tile.y >= 0 && tile.x < size.x && tile.y < size.y &&
+		    (tileFlags[tile.x + tile.y * size.x] & TILE_DOOR) != 0)
+			enteredDoors.emplace_back(entities[i], tile);
+	}
+}
+
+void AgentGrid::hashAgents()
+{
+	const int count = getAgentCount();
+
+	// power of two, so hashes can be masked
+	std::size_t buckets = 16;
+	while (buckets < (std::size_t) count * 2)
+		buckets *= 2;
+
+	bucketHeads.assign(buckets, -1);
+	nextInBucket.assign(count, -1);
+
+	for (int i = 0; i < count; ++i)
+	{
+		sf::Vector2i cell = getFootTile(posX[i], posY[i]);
+		int bucket = getBucket(cell.x, cell.y);
+		nextInBucket[i] = bucketHeads[bucket];
+		bucketHeads[bucket] = i;
+	}
+
+	hashed = true;
+}
+
+void AgentGrid::separateAgents()
+{
+	const int count = getAgentCount();
+	const float minDistance = getRadius() * 2;
+
+	for (int i = 0; i < count; ++i)
+	{
+		if (!entityCollision[i])
+			continue;
+
+		// neighbouring cells may share a bucket
+		int visited[9];
+		int visitedCount = 0;
+
+		sf::Vector2i cell = getFootTile(posX[i], posY[i]);
+		for (int dy = -1; dy <= 1; ++dy)
+		{
+			for (int dx = -1; dx <= 1; ++dx)
+			{
+				int bucket = getBucket(cell.x + dx, cell.y + dy);
+				if (std::find(visited, visited + visitedCount, bucket) != visited + visitedCount)
+					continue;
+				visited[visitedCount++] = bucket;
+
+				for (int j = bucketHeads[bucket]; j != -1; j = nextInBucket[j])
+				{
+					// each pair once
+					if (j <= i || !entityCollision[j])
+						continue;
+
+					float offsetX = posX[j] - posX[i];
+					float offsetY = posY[j] - posY[i];
+					float distanceSqrd = offsetX * offsetX + offsetY * offsetY;
+					if (distanceSqrd >= minDistance * minDistance)
+						continue;
+
+					float distance = sqrt(distanceSqrd);
+					float nx = 1.f, ny = 0.f;
+					if (distance > 0.0001f)
+					{
+						nx = offsetX / distance;
+						ny = offsetY / distance;
+					}
+
+					// push both apart equally
+					float push = (minDistance - distance) / 2;
+					posX[i] -= nx * push;
+					posY[i] -= ny * push;
+					posX[j] += nx * push;
+					posY[j] += ny * push;
+				}
+			}
+		}
+	}
+}
+
+void AgentGrid::collideWithTiles(int index)
+{
+	sf::Vector2i size = container->getTileSize();
+	const float radius = getRadius();
+
+	float footX = posX[index];
+	float footY = posY[index] + getFootOffset();
+
+	int left = (int) floor(footX - radius);
+	int right = (int) floor(footX + radius);
+	int top = (int) floor(footY - radius);
+	int bottom = (int) floor(footY + radius);
+
+	for (int y = top; y <= bottom; ++y)
+	{
+		for (int x = left; x <= right; ++x)
+		{
+			// outside the world is solid too
+			bool inside = x >= 0 && y >= 0 && x < size.x && y < size.y;
+			if (inside && (tileFlags[x + y * size.x] & TILE_SOLID) == 0)
+				continue;
+
+			// closest point of the tile
+			float closestX = std::max((float) x, std::min(footX, x + 1.f));
+			float closestY = std::max((float) y, std::min(footY, y + 1.f));
+			float offsetX = footX - closestX;
+			float offsetY = footY - closestY;
+			float distanceSqrd = offsetX * offsetX + offsetY * offsetY;
+			if (distanceSqrd >= radius * radius)
+				continue;
+
+			float nx, ny, depth;
+			if (distanceSqrd > 0.00000001f)
+			{
+				float distance = sqrt(distanceSqrd);
+				nx = offsetX / distance;
+				ny = offsetY / distance;
+				depth = radius - distance;
+			}
+
+			// centre inside the tile, so leave by the nearest side
+			else
+			{
+				float sides[] = {footX - x, x + 1.f - footX, footY - y, y + 1.f - footY};
+				int nearest = std::min_element(sides, sides + 4) - sides;
+				nx = nearest == 0 ? -1.f : nearest == 1 ? 1.f : 0.f;
+				ny = nearest == 2 ? -1.f : nearest == 3 ? 1.f : 0.f;
+				depth = sides[nearest] + radius;
+			}
+
+			footX += nx * depth;
+			footY += ny * depth;
+
+			// slide along the tile
+			float along = velX[index] * nx + velY[index] * ny;
+			if (along < 0.f)
+			{
+				velX[index] -= along * nx;
+				velY[index] -= along * ny;
+			}
+		}
+	}
+
+	posX[index] = footX;
+	posY[index] = footY - getFootOffset();
+}
+
+void AgentGrid::queryRegion(const sf::FloatRect &tiles, std::vector<EntityID> &out) const
+{
+	const int count = getAgentCount();
+	int left = (int) floor(tiles.left);
+	int top = (int) floor(tiles.top);
+	int right = (int) floor(tiles.left + tiles.width);
+	int bottom = (int) floor(tiles.top + tiles.height);
+
+	// not worth walking if the region has more cells than there are agents
+	bool useHash = hashed &&
+	               (long) (right - left + 1) * (bottom - top + 1) < count;
+
+	if (!useHash)
+	{
+		for (int i = 0; i < count; ++i)
+			if (tiles.contains(posX[i], posY[i]))
+				out.push_back(entities[i]);
+		return;
+	}
+
+	// hashed by foot tile, and agents move a little after hashing
+	const int margin = 1 + (int) ceil(getFootOffset());
+	std::vector<int> buckets;
+	for (int y = top - margin; y <= bottom + margin; ++y)
+		for (int x = left - margin; x <= right + margin; ++x)
+			buckets.push_back(getBucket(x, y));
+
+	// neighbouring cells may share a bucket
+	std::sort(buckets.begin(), buckets.end());
+	buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+
+	for (int bucket : buckets)
+		for (int i = bucketHeads[bucket]; i != -1; i = nextInBucket[i])
+			if (tiles.contains(posX[i], posY[i]))
+				out.push_back(entities[i]);
+}
@@ -41,6 +41,21 @@ Building *BuildingConnectionMap::getBuildingByID(BuildingID id)
 }
 
 
+void BuildingConnectionMap::discoverWindows(const sf::IntRect &region)
+{
+	for (auto &buildingPair : buildings)
+	{
+		Building &building = buildingPair.second;
+		sf::IntRect bounds = building.getBounds();
+
+		// inclusive of the far edges, as when first discovered
+		bounds.width += 1;
+		bounds.height += 1;
+		if (bounds.intersects(region))
+			building.discoverWindows();
+	}
+}
+
 void BuildingConnectionMap::getBuildingByOutsideDoorTile(const sf::Vector2i &tile,
 		boost::optional<std::pair<BuildingID, DoorID>> &out)
 {
@@ -1,263 +1,704 @@
+#include <algorithm>
 #include "world.hpp"
 #include "service/render_service.hpp"
 #include "service/locator.hpp"
 
 CollisionMap::CollisionMap(World *container) 
-: BaseWorld(container), world({0.f, 0.f})
+: BaseWorld(container), world({0.f, 0.f}), staticBodyCount(0), 
+	agents(container), globalContactListener(this), fixtureDestructionListener(&bodyDataPool), doorCount(0)
 	{
 		world.SetAllowSleeping(true);
 		world.SetContactListener(&globalContactListener);
+		world.SetDestructionListener(&fixtureDestructionListener);
 	}
 
+const int BODYDATA_BLOCK_SIZE = 32;
 
-void CollisionMap::findCollidableTiles(std::vector<CollisionRect> &rects) const
+BodyDataPool::BodyDataPool() : inUse(0)
 {
-	sf::Vector2i worldTileSize = container->getTileSize();
+}
+
+BodyDataPool::~BodyDataPool()
+{
+	for (BodyData *block : blocks)
+		delete[] block;
+}
 
-	// find collidable tiles
-	sf::Vector2f size(Constants::tileSizef, Constants::tileSizef); // todo: assuming all tiles are the same size
-	for (auto y = 0; y < worldTileSize.y; ++y)
+BodyData *BodyDataPool::acquire()
+{
+	if (freeList.empty())
 	{
-		for (auto x = 0; x < worldTileSize.x; ++x)
+		BodyData *block = new BodyData[BODYDATA_BLOCK_SIZE];
+		blocks.push_back(block);
+
+		// hand out from the front of the block first
+		for (int i = BODYDATA_BLOCK_SIZE - 1; i >= 0; --i)
+			freeList.push_back(&block[i]);
+	}
+
+	BodyData *data = freeList.back();
+	freeList.pop_back();
+	++inUse;
+	return data;
+}
+
+void BodyDataPool::release(BodyData *data)
+{
+	freeList.push_back(data);
+	--inUse;
+}
+
+int BodyDataPool::getInUseCount() const
+{
+	return inUse;
+}
+
+int BodyDataPool::getCapacity() const
+{
+	return (int) blocks.size() * BODYDATA_BLOCK_SIZE;
+}
+
+void CollisionMap::FixtureDestructionListener::SayGoodbye(b2Fixture *fixture)
+{
+	// entities own their BodyData
+	BodyData *data = static_cast<BodyData *>(fixture->GetUserData());
+	if (data != nullptr && data->type == BODYDATA_BLOCK)
+		pool->release(data);
+}
+
+
+void WorldTerrain::meshCollidableTiles(int chunk, std::vector<CollisionRect> &rects)
+{
+	sf::IntRect bounds = getChunkBounds(chunk);
+	const int width = bounds.width;
+	const int height = bounds.height;
+
+	// the block type of every collidable tile left to mesh
+	const unsigned char none = BLOCK_UNKNOWN;
+	std::vector<unsigned char> grid(width * height, none);
+
+	// the only collidable tile layer
+	const TileData *terrainTiles = &tiles[getTileIndex({0, 0}, LAYER_TERRAIN)];
+	for (int y = 0; y < height; ++y)
+	{
+		const TileData *row = &terrainTiles[bounds.left + (bounds.top + y) * size.x];
+		for (int x = 0; x < width; ++x)
 		{
-			// the only collidable tile layer
-			BlockType bt = container->getTerrain()->getBlockType({x, y}, LAYER_TERRAIN);
-			BlockInteractivity interactivity = getInteractivity(bt);
+			BlockType bt = static_cast<BlockType>(row[x].blockType);
+			if (getInteractivity(bt) != INTERACTIVTY_NONE)
+				grid[x + y * width] = row[x].blockType;
+		}
+	}
 
-			if (interactivity != INTERACTIVTY_NONE)
+	// grow each rect as wide, then as tall as possible
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			const unsigned char blockType = grid[x + y * width];
+			if (blockType == none)
+				continue;
+
+			int w = 1;
+			while (x + w < width && grid[x + w + y * width] == blockType)
+				++w;
+
+			int h = 1;
+			for (; y + h < height; ++h)
 			{
-				sf::Vector2f pos(Utils::toPixel(sf::Vector2f(x, y)));
-				rects.emplace_back(sf::FloatRect(pos, size), 0.f, bt);
+				const unsigned char *row = &grid[x + (y + h) * width];
+				if (std::find_if(row, row + w, [blockType](unsigned char b) { return b != blockType; }) != row + w)
+					break;
 			}
+
+			// consume
+			for (int dy = 0; dy < h; ++dy)
+				std::fill_n(&grid[x + (y + dy) * width], w, none);
+
+			sf::Vector2f pos(Utils::toPixel(sf::Vector2f(bounds.left + x, bounds.top + y)));
+			sf::Vector2f dimensions(Utils::toPixel(sf::Vector2f(w, h)));
+			rects.emplace_back(sf::FloatRect(pos, dimensions), 0.f, static_cast<BlockType>(blockType));
+
+			x += w - 1;
 		}
 	}
+}
 
-	// objects
-	auto objects = container->getTerrain()->getObjects();
-	for (auto &obj : objects)
+void WorldTerrain::findCollidableObjects(int chunk, std::vector<CollisionRect> &rects)
+{
+	// freely placed and rotated, so never merged
+	sf::Vector2f tileSize(Constants::tileSizef, Constants::tileSizef); // todo: assuming all tiles are the same size
+	for (std::size_t objectIndex : chunkObjects[chunk])
 	{
+		const WorldObject &obj = objects[objectIndex];
 		auto pos = obj.tilePos;
 		pos.y -= 1 / Constants::scale;
 		pos = Math::multiply(pos, Constants::tileScale);
 
-		rects.emplace_back(sf::FloatRect(pos, size), obj.rotation, obj.type);
+		rects.emplace_back(sf::FloatRect(pos, tileSize), obj.rotation, obj.type);
 	}
 }
 
-bool CollisionMap::compareRectsHorizontally(const CollisionRect &acr, const CollisionRect &bcr)
+CollisionMap::~CollisionMap()
 {
-	const sf::FloatRect &a = acr.rect;
-	const sf::FloatRect &b = bcr.rect;
-
-	if (a.top < b.top) return true;
-	if (b.top < a.top) return false;
-
-	if (a.left < b.left) return true;
-	if (b.left < a.left) return false;
-
-	return false;
+	for (std::size_t chunk = 0; chunk < chunkBodies.size(); ++chunk)
+		unloadChunk(chunk);
 }
 
-bool CollisionMap::compareRectsVertically(const CollisionRect &acr, const CollisionRect &bcr)
+void WorldTerrain::loadBlockData()
 {
-	const sf::FloatRect &a = acr.rect;
-	const sf::FloatRect &b = bcr.rect;
+	int totalChunks = chunkCount.x * chunkCount.y;
+	chunkCollisionRects.assign(totalChunks, std::vector<CollisionRect>());
+	chunkObjectRects.assign(totalChunks, std::vector<CollisionRect>());
+	chunkCollisionOutlines.assign(totalChunks, std::vector<CollisionOutline>());
 
-	if (a.left < b.left) return true;
-	if (b.left < a.left) return false;
+	collisionOutlines = Config::getBool("world.collision-outlines", false);
 
-	if (a.top < b.top) return true;
-	if (b.top < a.top) return false;
+	// fixtures and proxies, ignoring world borders
+	std::size_t boxes = 0, outlineFixtures = 0, outlineProxies = 0;
 
-	return false;
+	for (int chunk = 0; chunk < totalChunks; ++chunk)
+	{
+		meshCollidableTiles(chunk, chunkCollisionRects[chunk]);
+		findCollidableObjects(chunk, chunkObjectRects[chunk]);
+		traceCollisionOutlines(chunk, chunkCollisionOutlines[chunk]);
+
+		std::size_t interactables = std::count_if(
+				chunkCollisionRects[chunk].begin(), chunkCollisionRects[chunk].end(),
+				[](const CollisionRect &r) { return isInteractable(r.blockType); });
+
+		boxes += chunkCollisionRects[chunk].size() + chunkObjectRects[chunk].size();
+		outlineFixtures += chunkCollisionOutlines[chunk].size() + interactables + chunkObjectRects[chunk].size();
+		outlineProxies += interactables + chunkObjectRects[chunk].size();
+		for (const CollisionOutline &outline : chunkCollisionOutlines[chunk])
+			outlineProxies += outline.size();
+	}
+
+	Logger::logDebug(format("Static collision is %1% fixtures/proxies as boxes, or %2% fixtures with %3% proxies as outlines",
+	                        _str(boxes), _str(outlineFixtures), _str(outlineProxies)));
 }
 
-void CollisionMap::mergeRectangles(std::vector<CollisionRect> &src, std::vector<CollisionRect> &dst,
-                                   bool (*pred)(const CollisionRect &))
+void WorldTerrain::remeshRegion(const sf::IntRect &tiles)
 {
-	// TODO: use STL collection wizardry
-	dst.clear();
-	auto it = src.begin();
-	while (it != src.end())
+	std::vector<int> affected;
+	getChunksInRegion(tiles, affected);
+
+	for (int chunk : affected)
 	{
-		if (pred(*it))
-		{
-			dst.push_back(*it);
-			it = src.erase(it);
-		}
-		else
-			++it;
-	}
+		chunkCollisionRects[chunk].clear();
+		chunkCollisionOutlines[chunk].clear();
 
-	// join individual rects
-	sort(dst.begin(), dst.end(), compareRectsHorizontally);
-	mergeHelper(dst,
-	            [](const CollisionRect *last, const CollisionRect *current)
-	            {
-		            // same blocktype
-		            if (last->blockType != current->blockType)
-			            return true;
+		meshCollidableTiles(chunk, chunkCollisionRects[chunk]);
+		traceCollisionOutlines(chunk, chunkCollisionOutlines[chunk]);
+	}
 
-		            float (*square)(float) = [](float f){ return f * f; };
+	++editGeneration;
+}
 
-		            const sf::FloatRect &rect = current->rect;
-		            const sf::FloatRect &lastRect = last->rect;
-		            return square(rect.left - lastRect.left) + square(rect.top - lastRect.top) >
-		                   Constants::tileSizef * Constants::tileSizef;
-	            });
+unsigned long WorldTerrain::getEditGeneration() const
+{
+	return editGeneration;
+}
 
-	// join rows together
-	sort(dst.begin(), dst.end(), compareRectsVertically);
-	mergeHelper(dst,
-	            [](const CollisionRect *last, const CollisionRect *current)
-	            {
-		            const sf::FloatRect &rect = current->rect;
-		            const sf::FloatRect &lastRect = last->rect;
+void WorldTerrain::getChunksInRegion(const sf::IntRect &tiles, std::vector<int> &out) const
+{
+	int from = getChunkIndex(sf::Vector2i(tiles.left, tiles.top));
+	int to = getChunkIndex(sf::Vector2i(tiles.left + tiles.width - 1, tiles.top + tiles.height - 1));
 
-		            // adjacent and same dimensions
-		            return !(lastRect.left <= rect.left + rect.width &&
-		                     rect.left <= lastRect.left + lastRect.width &&
-		                     lastRect.top <= rect.top + rect.height &&
-		                     rect.top <= lastRect.top + lastRect.height &&
-		                     lastRect.width == rect.width && lastRect.height == rect.height);
-	            });
+	for (int y = from / chunkCount.x; y <= to / chunkCount.x; ++y)
+		for (int x = from % chunkCount.x; x <= to % chunkCount.x; ++x)
+			out.push_back(x + y * chunkCount.x);
+}
 
-	// add back to returning list
-	for (auto &mergedRect : dst)
-		src.push_back(mergedRect);
+const std::vector<CollisionRect> &WorldTerrain::getCollisionRects(int chunk) const
+{
+	return chunkCollisionRects.at(chunk);
 }
 
-void CollisionMap::mergeAdjacentTiles(std::vector<CollisionRect> &rects)
+const std::vector<CollisionRect> &WorldTerrain::getObjectCollisionRects(int chunk) const
 {
-	std::vector<CollisionRect> rectangles;
+	return chunkObjectRects.at(chunk);
+}
 
-	mergeRectangles(rects, rectangles,
-	                [](const CollisionRect &r)
-	                { return !isInteractable(r.blockType) && r.rotation == 0.f; });
+const std::vector<CollisionOutline> &WorldTerrain::getCollisionOutlines(int chunk) const
+{
+	return chunkCollisionOutlines.at(chunk);
+}
 
-	mergeRectangles(rects, rectangles,
-	                [](const CollisionRect &r)
-	                { return isInteractable(r.blockType); });
+bool WorldTerrain::usesCollisionOutlines() const
+{
+	return collisionOutlines;
 }
 
-void CollisionMap::mergeHelper(std::vector<CollisionRect> &rects,
-                               bool (*nextRowFunc)(const CollisionRect *last, const CollisionRect *current))
+void WorldTerrain::traceCollisionOutlines(int chunk, std::vector<CollisionOutline> &outlines)
 {
-	std::vector<CollisionRect> rectsCopy(rects.begin(), rects.end());
-	rects.clear();
+	sf::IntRect bounds = getChunkBounds(chunk);
+	const int width = bounds.width;
+	const int height = bounds.height;
+
+	// solid tiles, which don't need block data
+	std::vector<bool> solid(width * height, false);
+	const TileData *terrainTiles = &tiles[getTileIndex({0, 0}, LAYER_TERRAIN)];
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			BlockType bt = static_cast<BlockType>(terrainTiles[bounds.left + x + (bounds.top + y) * size.x].blockType);
+			solid[x + y * width] = isCollidable(bt) && !isInteractable(bt);
+		}
+	}
 
-	CollisionRect *current = nullptr;
-	CollisionRect *lastRect = nullptr;
+	auto isSolid = [&](int x, int y)
+	{
+		return x >= 0 && y >= 0 && x < width && y < height && solid[x + y * width];
+	};
 
-	static CollisionRect placeholder(sf::FloatRect(-100.f, -100.f, 0.f, 0.f), 0.f);
-	rectsCopy.push_back(placeholder); // to ensure the last rect is included
+	// directed boundary edges leaving each corner, clockwise with the solid side on the right
+	enum { NORTH, EAST, SOUTH, WEST };
+	const int dx[] = {0, 1, 0, -1};
+	const int dy[] = {-1, 0, 1, 0};
 
-	for (size_t i = 0; i < rectsCopy.size(); ++i)
+	const int corners = width + 1;
+	std::vector<unsigned char> edges(corners * (height + 1), 0);
+	for (int y = 0; y < height; ++y)
 	{
-		CollisionRect *rect = &rectsCopy[i];
-
-		// no current rect expanding
-		if (current == nullptr)
+		for (int x = 0; x < width; ++x)
 		{
-			current = lastRect = rect;
-			continue;
+			if (!solid[x + y * width])
+				continue;
+
+			if (!isSolid(x, y - 1))
+				edges[x + y * corners] |= 1 << EAST;
+			if (!isSolid(x + 1, y))
+				edges[(x + 1) + y * corners] |= 1 << SOUTH;
+			if (!isSolid(x, y + 1))
+				edges[(x + 1) + (y + 1) * corners] |= 1 << WEST;
+			if (!isSolid(x - 1, y))
+				edges[x + (y + 1) * corners] |= 1 << NORTH;
 		}
+	}
 
-		// done with current
-		if ((nextRowFunc)(lastRect, rect))
+	// follow edges until back at the start
+	CollisionOutline outline;
+	for (std::size_t start = 0; start < edges.size(); ++start)
+	{
+		while (edges[start] != 0)
 		{
-			rects.push_back(*current);
+			const int startX = start % corners;
+			const int startY = start / corners;
+			int x = startX;
+			int y = startY;
 
-			// move on
-			current = lastRect = rect;
-			continue;
-		}
+			int dir = NORTH;
+			while (!(edges[start] & (1 << dir)))
+				++dir;
 
-		// stretch current
-		const sf::FloatRect &mergeRect = rect->rect;
-		sf::FloatRect &currentRect = current->rect;
+			outline.clear();
+			while (true)
+			{
+				edges[x + y * corners] &= ~(1 << dir);
+				outline.emplace_back(x, y);
+
+				x += dx[dir];
+				y += dy[dir];
+				if (x == startX && y == startY)
+					break;
+
+				// prefer turning right, so regions touching diagonally stay separate
+				unsigned char out = edges[x + y * corners];
+				if (out == 0)
+					error("Unclosed collision outline at (%1%, %2%)", _str(bounds.left + x), _str(bounds.top + y));
+
+				for (int turn : {1, 0, 3})
+				{
+					int next = (dir + turn) % 4;
+					if (out & (1 << next))
+					{
+						dir = next;
+						break;
+					}
+				}
+			}
 
-		currentRect.left     = std::min(currentRect.left, mergeRect.left);
-		currentRect.top      = std::min(currentRect.top, mergeRect.top);
-		currentRect.width    = std::max(currentRect.left + currentRect.width,
-		                                mergeRect.left + mergeRect.width) - currentRect.left;
-		currentRect.height   = std::max(currentRect.top + currentRect.height,
-		                                mergeRect.top + mergeRect.height) - currentRect.top;
+			// only keep corners
+			CollisionOutline loop;
+			const std::size_t n = outline.size();
+			for (std::size_t i = 0; i < n; ++i)
+			{
+				const sf::Vector2f &prev = outline[(i + n - 1) % n];
+				const sf::Vector2f &current = outline[i];
+				const sf::Vector2f &next = outline[(i + 1) % n];
+
+				bool straight = (prev.x == current.x && current.x == next.x) ||
+				                (prev.y == current.y && current.y == next.y);
+				if (!straight)
+					loop.emplace_back(current.x + bounds.left, current.y + bounds.top);
+			}
 
-		lastRect = rect;
+			outlines.push_back(loop);
+		}
 	}
 }
 
-CollisionMap::~CollisionMap()
+void CollisionMap::load()
 {
-	if (worldBody != nullptr)
-		world.DestroyBody(worldBody);
+	createFixtures();
+	finishLoading();
 }
 
-void CollisionMap::load()
+void CollisionMap::finishLoading()
 {
-	std::vector<CollisionRect> rects;
-
-	// gather all collidable tiles
-	findCollidableTiles(rects);
+	logMissingDoors();
 
-	// merge adjacents
-	mergeAdjacentTiles(rects);
+	Logger::logDebuggiest(format("Added %1% door block data in world %2%", _str(doorCount), _str(container->getID())));
+	Logger::logDebuggiest(format("World %1% has %2% static fixtures with %3% broadphase proxies",
+	                             _str(container->getID()), _str(getStaticFixtureCount()), _str(getStaticProxyCount())));
 
 	// debug drawing
 	sf::RenderWindow *window = Locator::locate<RenderService>()->getWindow();
 	if (Config::getBool("debug.render-physics", false) && window != nullptr)
 	{
 		b2Renderer.emplace(*window);
-		world.SetDebugDraw(&*b2Renderer);
 		b2Renderer->SetFlags(b2Draw::e_shapeBit);
 	}
+}
+
+void CollisionMap::renderDebug(const sf::FloatRect &visibleTiles)
+{
+	if (!b2Renderer)
+		return;
+
+	b2AABB region;
+	region.lowerBound.Set(visibleTiles.left, visibleTiles.top);
+	region.upperBound.Set(visibleTiles.left + visibleTiles.width, visibleTiles.top + visibleTiles.height);
+
+	b2Renderer->DrawFixtures(world, region);
+	b2Renderer->Flush();
+}
+
+void CollisionMap::logMissingDoors()
+{
+	for (const sf::Vector2i &tilePos : missingDoors)
+		Logger::logWarning(format("Cannot add block data for door at (%1%, %2%) in world %3%, because there is no %4% there",
+		                          _str(tilePos.x), _str(tilePos.y), _str(container->getID()),
+		                          container->isOutside() ? "building" : "door"));
+	missingDoors.clear();
+}
+
+void CollisionMap::createFixtures()
+{
+	WorldTerrain *terrain = container->getTerrain();
+	sf::Vector2i chunkCount = terrain->getChunkCount();
+	int totalChunks = chunkCount.x * chunkCount.y;
+
+	chunkBodies.assign(totalChunks, nullptr);
+	chunkIdleTimes.assign(totalChunks, 0.f);
+
+	// streamed chunks are loaded around entities as they move
+	if (terrain->isStreamed())
+		return;
 
-	// create world body
-	b2BodyDef worldBodyDef;
-	worldBodyDef.type = b2_staticBody;
-	worldBody = world.CreateBody(&worldBodyDef);
+	for (int chunk = 0; chunk < totalChunks; ++chunk)
+		loadChunk(chunk);
+}
+
+void CollisionMap::loadChunk(int chunk)
+{
+	if (chunkBodies[chunk] != nullptr)
+		return;
+
+	// shared with all other worlds using this terrain
+	WorldTerrain *terrain = container->getTerrain();
+	const std::vector<CollisionRect> &terrainRects = terrain->getCollisionRects(chunk);
+	const std::vector<CollisionRect> &objectRects = terrain->getObjectCollisionRects(chunk);
+	const bool outlined = terrain->usesCollisionOutlines();
+
+	// create chunk body
+	b2BodyDef chunkBodyDef;
+	chunkBodyDef.type = b2_staticBody;
+	b2Body *chunkBody = world.CreateBody(&chunkBodyDef);
+
+	chunkBodies[chunk] = chunkBody;
+	chunkIdleTimes[chunk] = 0.f;
+	++staticBodyCount;
+
+	// world borders, split between the edge chunks
+	sf::IntRect tiles = terrain->getChunkBounds(chunk);
+	sf::Vector2i worldTiles = terrain->getSize();
+	sf::FloatRect bounds(Utils::toPixel(sf::Vector2f(tiles.left, tiles.top)),
+	                     Utils::toPixel(sf::Vector2f(tiles.width, tiles.height)));
 
-	// world borders
 	int borderThickness = Constants::tileSize;
 	int padding = Constants::tileSize / 4;
 	auto worldSize = container->getPixelSize();
-	rects.emplace_back(sf::FloatRect(-borderThickness - padding, 0, borderThickness, worldSize.y), 0.f);
-	rects.emplace_back(sf::FloatRect(0, -borderThickness - padding, worldSize.x, borderThickness), 0.f);
-	rects.emplace_back(sf::FloatRect(worldSize.x + padding, 0, borderThickness, worldSize.y), 0.f);
-	rects.emplace_back(sf::FloatRect(0, worldSize.y + padding, worldSize.x, borderThickness), 0.f);
-
-	// collision fixtures
+	std::vector<CollisionRect> borders;
+	if (tiles.left == 0)
+		borders.emplace_back(sf::FloatRect(-borderThickness - padding, bounds.top, borderThickness, bounds.height), 0.f);
+	if (tiles.top == 0)
+		borders.emplace_back(sf::FloatRect(bounds.left, -borderThickness - padding, bounds.width, borderThickness), 0.f);
+	if (tiles.left + tiles.width == worldTiles.x)
+		borders.emplace_back(sf::FloatRect(worldSize.x + padding, bounds.top, borderThickness, bounds.height), 0.f);
+	if (tiles.top + tiles.height == worldTiles.y)
+		borders.emplace_back(sf::FloatRect(bounds.left, worldSize.y + padding, bounds.width, borderThickness), 0.f);
+
+	// collision fixtures, which only ever touch entities
 	b2FixtureDef fixDef;
 	b2PolygonShape box;
-	fixDef.shape = &box;
 	fixDef.friction = 0.1f;
+	fixDef.filter.categoryBits = COLLISION_TERRAIN;
+	fixDef.filter.maskBits = COLLISION_ENTITY;
+
+	// solid tiles as outline loops instead of boxes
+	if (outlined)
+	{
+		std::vector<b2Vec2> vertices;
+		for (const CollisionOutline &outline : terrain->getCollisionOutlines(chunk))
+		{
+			vertices.clear();
+			for (const sf::Vector2f &corner : outline)
+				vertices.emplace_back(corner.x, corner.y);
+
+			b2ChainShape loop;
+			loop.CreateLoop(&vertices[0], vertices.size());
+			fixDef.shape = &loop;
+			fixDef.userData = nullptr;
+			chunkBody->CreateFixture(&fixDef);
+		}
+	}
+
+	fixDef.shape = &box;
+	const std::vector<CollisionRect> *rectLists[] = {&terrainRects, &objectRects, &borders};
+	for (const std::vector<CollisionRect> *rects : rectLists)
+	{
+		for (const CollisionRect &collisionRect : *rects)
+		{
+			// already outlined
+			if (outlined && rects == &terrainRects && !isInteractable(collisionRect.blockType))
+				continue;
+
+			sf::FloatRect unrotated = Utils::scaleToBox2D(collisionRect.rect);
+			sf::Vector2f size(unrotated.width, unrotated.height);
+			sf::FloatRect aabb = getTileBounds(collisionRect);
+			fixDef.userData = nullptr;
+
+			// attach block data
+			fixDef.userData = createBodyData(collisionRect.blockType, {(int) aabb.left, (int) aabb.top});
+
+			// doors are walked into rather than bumped against
+			bool door = fixDef.userData != nullptr;
+			fixDef.isSensor = door;
+			fixDef.filter.categoryBits = door ? COLLISION_DOOR : COLLISION_TERRAIN;
+
+			box.SetAsBox(
+					size.x / 2, // half dimensions
+					size.y / 2,
+					b2Vec2(aabb.left + aabb.width / 2, aabb.top + aabb.height / 2),
+					collisionRect.rotation
+			);
+			chunkBody->CreateFixture(&fixDef);
+		}
+	}
+}
+
+sf::FloatRect CollisionMap::getTileBounds(const CollisionRect &collisionRect)
+{
+	sf::FloatRect aabb = Utils::scaleToBox2D(collisionRect.rect);
+
+	// rotated
+	if (collisionRect.rotation != 0.f)
+	{
+		sf::Transform transform;
+		transform.rotate(collisionRect.rotation, aabb.left, aabb.top + aabb.height);
+		aabb = transform.transformRect(aabb);
+	}
+
+	return aabb;
+}
+
+sf::Vector2i CollisionMap::getDoorTile(const sf::Vector2i &tile) const
+{
+	// door BodyData is keyed by the top left of the merged door rect
+	WorldTerrain *terrain = container->getTerrain();
+	sf::Vector2f centre(tile.x + 0.5f, tile.y + 0.5f);
 
-	for (auto &collisionRect : rects)
+	for (const CollisionRect &collisionRect : terrain->getCollisionRects(terrain->getChunkIndex(tile)))
 	{
-		sf::FloatRect aabb = Utils::scaleToBox2D(collisionRect.rect);
-		sf::Vector2f size(aabb.width, aabb.height);
-		fixDef.userData = nullptr;
+		if (!isInteractable(collisionRect.blockType))
+			continue;
+
+		sf::FloatRect aabb = getTileBounds(collisionRect);
+		if (aabb.contains(centre))
+			return {(int) aabb.left, (int) aabb.top};
+	}
 
-		// rotated
-		if (collisionRect.rotation != 0.f)
+	return tile;
+}
+
+void CollisionMap::unloadChunk(int chunk)
+{
+	b2Body *chunkBody = chunkBodies[chunk];
+	if (chunkBody == nullptr)
+		return;
+
+	// BodyData is released by the destruction listener
+	world.DestroyBody(chunkBody);
+	chunkBodies[chunk] = nullptr;
+	--staticBodyCount;
+}
+
+void CollisionMap::streamChunks(float delta)
+{
+	WorldTerrain *terrain = container->getTerrain();
+	if (!terrain->isStreamed())
+		return;
+
+	int radius = Config::getInt("world.chunks.collision-radius", 1);
+	float idleTimeout = Config::getFloat("world.chunks.collision-idle-timeout", 5.f);
+
+	// chunks around every dynamic body
+	sf::Vector2i chunkCount = terrain->getChunkCount();
+	std::vector<bool> needed(chunkBodies.size(), false);
+	for (b2Body *body = world.GetBodyList(); body; body = body->GetNext())
+	{
+		if (body->GetType() != b2_dynamicBody || !body->IsActive())
+			continue;
+
+		const b2Vec2 &pos = body->GetPosition();
+		int centre = terrain->getChunkIndex(sf::Vector2i((int) pos.x, (int) pos.y));
+		int centreX = centre % chunkCount.x;
+		int centreY = centre / chunkCount.x;
+
+		for (int y = std::max(0, centreY - radius); y <= std::min(chunkCount.y - 1, centreY + radius); ++y)
+			for (int x = std::max(0, centreX - radius); x <= std::min(chunkCount.x - 1, centreX + radius); ++x)
+				needed[x + y * chunkCount.x] = true;
+	}
+
+	for (std::size_t chunk = 0; chunk < chunkBodies.size(); ++chunk)
+	{
+		if (needed[chunk])
+		{
+			loadChunk(chunk);
+			chunkIdleTimes[chunk] = 0.f;
+		}
+		else if (chunkBodies[chunk] != nullptr)
 		{
-			sf::Transform transform;
-			transform.rotate(collisionRect.rotation, aabb.left, aabb.top + aabb.height);
-			aabb = transform.transformRect(aabb);
+			chunkIdleTimes[chunk] += delta;
+			if (chunkIdleTimes[chunk] >= idleTimeout)
+				unloadChunk(chunk);
 		}
+	}
 
-		// attach block data
-		fixDef.userData = createBodyData(collisionRect.blockType, {(int) aabb.left, (int) aabb.top});
+	logMissingDoors();
+}
 
-		box.SetAsBox(
-				size.x / 2, // half dimensions
-				size.y / 2,
-				b2Vec2(aabb.left + aabb.width / 2, aabb.top + aabb.height / 2),
-				collisionRect.rotation
-		);
-		worldBody->CreateFixture(&fixDef);
+CollisionRebuildCost CollisionMap::rebuildRegion(const sf::IntRect &tiles)
+{
+	sf::Clock clock;
+	CollisionRebuildCost cost;
+
+	std::vector<int> affected;
+	container->getTerrain()->getChunksInRegion(tiles, affected);
+
+	for (int chunk : affected)
+	{
+		b2Body *chunkBody = chunkBodies[chunk];
+		if (chunkBody == nullptr)
+			continue;
+
+		for (b2Fixture *f = chunkBody->GetFixtureList(); f; f = f->GetNext())
+			++cost.fixturesRemoved;
+
+		unloadChunk(chunk);
+		loadChunk(chunk);
+
+		for (b2Fixture *f = chunkBodies[chunk]->GetFixtureList(); f; f = f->GetNext())
+			++cost.fixturesAdded;
+
+		++cost.chunks;
 	}
+
+	agents.refreshTiles(tiles);
+	logMissingDoors();
+
+	cost.milliseconds = clock.getElapsedTime().asMicroseconds() / 1000.f;
+	return cost;
+}
+
+bool CollisionMap::isChunkLoaded(int chunk) const
+{
+	return chunkBodies.at(chunk) != nullptr;
+}
+
+int CollisionMap::getStaticBodyCount() const
+{
+	return staticBodyCount;
+}
+
+int CollisionMap::getStaticFixtureCount() const
+{
+	int count = 0;
+	for (const b2Body *chunkBody : chunkBodies)
+		if (chunkBody != nullptr)
+			for (const b2Fixture *f = chunkBody->GetFixtureList(); f; f = f->GetNext())
+				++count;
+
+	return count;
+}
+
+int CollisionMap::getStaticProxyCount() const
+{
+	int count = 0;
+	for (const b2Body *chunkBody : chunkBodies)
+		if (chunkBody != nullptr)
+			for (const b2Fixture *f = chunkBody->GetFixtureList(); f; f = f->GetNext())
+				count += f->GetShape()->GetChildCount();
+
+	return count;
+}
+
+void CollisionMap::parkEntityBody(b2Body *body)
+{
+	int maxParked = Config::getInt("world.transfer.max-parked-bodies", 16);
+	if ((int) parkedBodies.size() >= maxParked)
+	{
+		world.DestroyBody(body);
+		return;
+	}
+
+	// removes its broadphase proxies and contacts, but keeps its fixtures
+	body->SetLinearVelocity(b2Vec2(0.f, 0.f));
+	body->SetActive(false);
+	parkedBodies.push_back(body);
+}
+
+b2Body *CollisionMap::unparkEntityBody(BodyData *data, const b2Filter &filter, const sf::Vector2f &pos)
+{
+	if (parkedBodies.empty())
+		return nullptr;
+
+	b2Body *body = parkedBodies.back();
+	parkedBodies.pop_back();
+
+	for (b2Fixture *f = body->GetFixtureList(); f; f = f->GetNext())
+	{
+		f->SetUserData(data);
+		f->SetFilterData(filter);
+	}
+
+	body->SetTransform(Utils::toB2Vec(pos), body->GetAngle());
+	body->SetActive(true);
+	body->SetAwake(true);
+	return body;
+}
+
+int CollisionMap::getParkedBodyCount() const
+{
+	return (int) parkedBodies.size();
+}
+
+const BodyDataPool &CollisionMap::getBodyDataPool() const
+{
+	return bodyDataPool;
 }
 
 BodyData *CollisionMap::createBodyData(BlockType blockType, const sf::Vector2i &tilePos)
@@ -268,29 +709,23 @@ BodyData *CollisionMap::createBodyData(BlockType blockType, const sf::Vector2i &
 		// building doors
 		if (blockType == BLOCK_SLIDING_DOOR)
 		{
-			BodyData *data = new BodyData; // todo cache
-			data->type = BODYDATA_BLOCK;
-			data->blockData.blockDataType = BLOCKDATA_DOOR;
-			data->blockData.location.set(container->getID(), tilePos);
-
 			boost::optional<std::pair<BuildingID, DoorID>> buildingAndDoor;
 			container->getBuildingConnectionMap()->getBuildingByOutsideDoorTile(tilePos, buildingAndDoor);
 
 			if (!buildingAndDoor)
 			{
-				Logger::logWarning(
-						format("Cannot add block data for door at (%1%, %2%), because there is no building there",
-						       _str(tilePos.x), _str(tilePos.y)));
+				missingDoors.push_back(tilePos);
 				return nullptr;
 			}
 
-			/* DoorBlockData *doorData = &data->blockData.door; */
+			BodyData *data = bodyDataPool.acquire();
+			data->type = BODYDATA_BLOCK;
+			data->blockData.blockDataType = BLOCKDATA_DOOR;
+			data->blockData.location.set(container->getID(), tilePos);
 
-			Logger::logDebuggiest(format("Added door block data to door %1% of building %2% in world %3%",
-			                             _str(buildingAndDoor->second),
-			                             _str(buildingAndDoor->first),
-			                             _str(container->getID())));
+			/* DoorBlockData *doorData = &data->blockData.door; */
 
+			++doorCount;
 			return data;
 		}
 	}
@@ -301,29 +736,22 @@ BodyData *CollisionMap::createBodyData(BlockType blockType, const sf::Vector2i &
 		// entrance
 		if (blockType == BLOCK_ENTRANCE_MAT)
 		{
-			BodyData *data = new BodyData; // todo cache
-			data->type = BODYDATA_BLOCK;
-			data->blockData.blockDataType = BLOCKDATA_DOOR;
-			data->blockData.location.set(container->getID(), tilePos);
-
 			Door *door = container->getDomesticConnectionMap()->getDoorByTile(tilePos);
 
 			if (door == nullptr)
 			{
-				Logger::logWarning(
-						format("Cannot add block data for door at (%1%, %2%), because there is no door there",
-						       _str(tilePos.x), _str(tilePos.y)));
+				missingDoors.push_back(tilePos);
 				return nullptr;
 			}
 
-			/* DoorBlockData *doorData = &data->blockData.door; */
+			BodyData *data = bodyDataPool.acquire();
+			data->type = BODYDATA_BLOCK;
+			data->blockData.blockDataType = BLOCKDATA_DOOR;
+			data->blockData.location.set(container->getID(), tilePos);
 
-			Location &loc = data->blockData.location;
-			Logger::logDebuggiest(format("Added door block data at (%1%, %2%) in world %3%",
-			                             _str(loc.x),
-			                             _str(loc.y),
-			                             _str(loc.world)));
+			/* DoorBlockData *doorData = &data->blockData.door; */
 
+			++doorCount;
 			return data;
 		}
 	}
@@ -336,52 +764,101 @@ void CollisionMap::GlobalContactListener::BeginContact(b2Contact *contact)
 	b2Fixture *a = contact->GetFixtureA();
 	b2Fixture *b = contact->GetFixtureB();
 
-	BodyData *aData = (BodyData *) a->GetUserData();
-	BodyData *bData = (BodyData *) b->GetUserData();
+	// door sensors only ever touch entities
+	b2Fixture *door = a->IsSensor() ? a : b->IsSensor() ? b : nullptr;
+	if (door == nullptr)
+		return;
+
+	b2Fixture *entity = door == a ? b : a;
+	BodyData *doorData = static_cast<BodyData *>(door->GetUserData());
+	BodyData *entityData = static_cast<BodyData *>(entity->GetUserData());
 
-	if (aData == nullptr || bData == nullptr)
+	if (doorData == nullptr || entityData == nullptr)
 		return;
 
-	// entity with block
-	if (aData->type != bData->type)
+	if (doorData->blockData.blockDataType == BLOCKDATA_DOOR)
+		map->doorContacts.emplace_back(doorData->blockData.location, entityData->entityID.id);
+}
+
+AgentGrid *CollisionMap::getAgentGrid()
+{
+	return &agents;
+}
+
+void CollisionMap::stepAgents(float delta)
+{
+	std::vector<std::pair<EntityID, sf::Vector2i>> enteredDoors;
+	agents.step(delta, enteredDoors);
+
+	for (auto &pair : enteredDoors)
+		doorContacts.emplace_back(Location(container->getID(), getDoorTile(pair.second)), pair.first);
+}
+
+void CollisionMap::queryEntities(const sf::FloatRect &tiles, std::vector<EntityID> &out)
+{
+	struct EntityQuery : public b2QueryCallback
 	{
-		BodyData *entity = aData->type == BODYDATA_ENTITY ? aData : bData;
-		BodyData *block = entity == aData ? bData : aData;
-		BlockData &blockData = block->blockData;
+		std::vector<EntityID> &out;
 
-		// door
-		if (block->blockData.blockDataType == BLOCKDATA_DOOR)
+		EntityQuery(std::vector<EntityID> &out) : out(out)
 		{
-			WorldService *ws = Locator::locate<WorldService>();
+		}
 
-			Location target;
-			if (!ws->getConnectionDestination(block->blockData.location, target))
-			{
-				Logger::logError(format("Door at (%1%, %2%) in world %3% has no target location",
-										_str(blockData.location.x),
-										_str(blockData.location.y),
-										_str(blockData.location.world)));
-				return;
-			}
+		bool ReportFixture(b2Fixture *fixture) override
+		{
+			BodyData *data = static_cast<BodyData *>(fixture->GetUserData());
+			if (data != nullptr && data->type == BODYDATA_ENTITY)
+				out.push_back(data->entityID.id);
+			return true;
+		}
+	} query(out);
 
-			Event event;
-			event.type = EVENT_HUMAN_SWITCH_WORLD;
-			event.entityID = entity->entityID.id;
-			event.humanSwitchWorld.newWorld = target.world;
+	b2AABB aabb;
+	aabb.lowerBound.Set(tiles.left, tiles.top);
+	aabb.upperBound.Set(tiles.left + tiles.width, tiles.top + tiles.height);
+	world.QueryAABB(&query, aabb);
 
-			/* event.humanSwitchWorld.spawnDirection = DIRECTION_NORTH; */ // todo store in Door
-			event.humanSwitchWorld.spawnX = target.x;
-			event.humanSwitchWorld.spawnY = target.y;
+	agents.queryRegion(tiles, out);
+}
 
-			Logger::logDebug(format("Door interaction at (%1%, %2%) in world %3%",
-			                        _str(blockData.location.x),
-			                        _str(blockData.location.y),
-			                        _str(blockData.location.world)));
+void CollisionMap::dispatchDoorContacts()
+{
+	if (doorContacts.empty())
+		return;
 
-			Locator::locate<EventService>()->callEvent(event);
+	WorldService *ws = Locator::locate<WorldService>();
+	EventService *es = Locator::locate<EventService>();
+
+	for (const DoorContact &contact : doorContacts)
+	{
+		const Location &door = contact.door;
+
+		Location target;
+		if (!ws->getConnectionDestination(door, target))
+		{
+			Logger::logError(format("Door at (%1%, %2%) in world %3% has no target location",
+									_str(door.x),
+									_str(door.y),
+									_str(door.world)));
+			continue;
 		}
 
+		Event event;
+		event.type = EVENT_HUMAN_SWITCH_WORLD;
+		event.entityID = contact.entity;
+		event.humanSwitchWorld.newWorld = target.world;
+
+		/* event.humanSwitchWorld.spawnDirection = DIRECTION_NORTH; */ // todo store in Door
+		event.humanSwitchWorld.spawnX = target.x;
+		event.humanSwitchWorld.spawnY = target.y;
+
+		Logger::logDebug(format("Door interaction at (%1%, %2%) in world %3%",
+		                        _str(door.x),
+		                        _str(door.y),
+		                        _str(door.world)));
 
+		es->callEvent(event);
 	}
 
+	doorContacts.clear();
 }
@@ -0,0 +1,148 @@
+#include <algorithm>
+#include "service/logging_service.hpp"
+#include "service/world_service.hpp"
+
+TerrainEdit::TerrainEdit(WorldID world) : world(world)
+{
+}
+
+TerrainEdit &TerrainEdit::setBlockType(const sf::Vector2i &tile, BlockType blockType, LayerType layer,
+                                       int rotationAngle, int flipGID)
+{
+	edits.push_back({tile, blockType, layer, rotationAngle, flipGID});
+	return *this;
+}
+
+WorldID TerrainEdit::getWorld() const
+{
+	return world;
+}
+
+const std::vector<TileEdit> &TerrainEdit::getEdits() const
+{
+	return edits;
+}
+
+bool TerrainEdit::isEmpty() const
+{
+	return edits.empty();
+}
+
+void WorldTerrain::applyEdits(const std::vector<TileEdit> &edits, std::vector<sf::IntRect> &dirtyRegions)
+{
+	// validate everything first, so a bad edit changes nothing
+	std::vector<int> indices;
+	indices.reserve(edits.size());
+	for (const TileEdit &edit : edits)
+		indices.push_back(getTileIndex(edit.tile, edit.layer));
+
+	// workers must not read tiles as they change
+	for (const TileEdit &edit : edits)
+		cancelChunkBuild(getChunkIndex(edit.tile));
+
+	std::map<int, sf::IntRect> regions;
+	for (std::size_t i = 0; i < edits.size(); ++i)
+	{
+		const TileEdit &edit = edits[i];
+
+		TileData &tile = tiles[indices[i]];
+		tile.blockType = static_cast<unsigned char>(edit.blockType);
+		tile.rotation = static_cast<short>(edit.rotationAngle);
+		tile.flipGID = edit.flipGID;
+
+		// grow the region of this chunk
+		int chunk = getChunkIndex(edit.tile);
+		auto region = regions.find(chunk);
+		if (region == regions.end())
+		{
+			regions.insert({chunk, sf::IntRect(edit.tile, sf::Vector2i(1, 1))});
+			continue;
+		}
+
+		sf::IntRect &r = region->second;
+		int right = std::max(r.left + r.width, edit.tile.x + 1);
+		int bottom = std::max(r.top + r.height, edit.tile.y + 1);
+		r.left = std::min(r.left, edit.tile.x);
+		r.top = std::min(r.top, edit.tile.y);
+		r.width = right - r.left;
+		r.height = bottom - r.top;
+	}
+
+	for (auto &pair : regions)
+		dirtyRegions.push_back(pair.second);
+}
+
+void WorldTerrain::rebuildRenderRegion(const sf::IntRect &tiles)
+{
+	std::vector<int> affected;
+	getChunksInRegion(tiles, affected);
+
+	// chunks that aren't built will be when they come into view
+	for (int chunk : affected)
+	{
+		auto built = chunks.find(chunk);
+		if (built != chunks.end())
+		{
+			buildChunk(chunk, built->second);
+			colourChunk(chunk, built->second);
+		}
+	}
+
+	bakeOverview(tiles);
+	refreshLightSources(tiles);
+}
+
+void WorldService::commitTerrainEdit(const TerrainEdit &edit)
+{
+	World *world = getWorld(edit.getWorld());
+	if (world == nullptr)
+		error("Cannot edit terrain of unknown world %1%", _str(edit.getWorld()));
+
+	if (edit.isEmpty())
+		return;
+
+	// prefetch workers read the tiles being edited
+	prefetcher.cancelTerrain(world->getTerrain());
+
+	std::vector<sf::IntRect> dirtyRegions;
+	world->getTerrain()->applyEdits(edit.getEdits(), dirtyRegions);
+
+	Logger::logDebuggier(format("Committed %1% tile edit(s) to world %2%, touching %3% chunk(s)",
+	                            _str(edit.getEdits().size()), _str(world->getID()), _str(dirtyRegions.size())));
+
+	for (const sf::IntRect &region : dirtyRegions)
+		for (TerrainEditListener *listener : terrainListeners)
+			listener->onTerrainEdit(world, region);
+}
+
+void WorldService::registerTerrainListener(TerrainEditListener *listener)
+{
+	Logger::logDebuggiest(format("Registering terrain edit listener \"%1%\"", listener->identifier));
+	terrainListeners.push_back(listener);
+}
+
+void WorldService::unregisterTerrainListener(TerrainEditListener *listener)
+{
+	terrainListeners.erase(std::remove(terrainListeners.begin(), terrainListeners.end(), listener),
+	                       terrainListeners.end());
+}
+
+void WorldService::TerrainRenderListener::onTerrainEdit(World *world, const sf::IntRect &region)
+{
+	world->getTerrain()->rebuildRenderRegion(region);
+}
+
+WorldService::TerrainCollisionListener::TerrainCollisionListener(WorldService *ws) : ws(ws)
+{
+}
+
+void WorldService::TerrainCollisionListener::onTerrainEdit(World *world, const sf::IntRect &region)
+{
+	ws->rebuildRegion(world->getID(), region);
+}
+
+void WorldService::BuildingIndexListener::onTerrainEdit(World *world, const sf::IntRect &region)
+{
+	if (world->isOutside())
+		world->getBuildingConnectionMap()->discoverWindows(region);
+}
@@ -0,0 +1,295 @@
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include "world.hpp"
+#include "service/config_service.hpp"
+
+void WorldTerrain::refreshLightSources(const sf::IntRect &tiles)
+{
+	// not lit until applied
+	if (lightSources.empty())
+		return;
+
+	sf::IntRect region;
+	if (!tiles.intersects({0, 0, size.x, size.y}, region))
+		return;
+
+	// the brightest source of each tile
+	std::vector<unsigned char> sources(region.width * region.height, 0);
+	for (auto &layer : tileLayerIndices)
+	{
+		const TileData *layerTiles = &this->tiles[layer.second.first * size.x * size.y];
+		for (int y = region.top; y < region.top + region.height; ++y)
+		{
+			for (int x = region.left; x < region.left + region.width; ++x)
+			{
+				unsigned char emission = (unsigned char) tileset->getLightEmission(layerTiles[x + y * size.x].blockType);
+				unsigned char &source = sources[(x - region.left) + (y - region.top) * region.width];
+				source = std::max(source, emission);
+			}
+		}
+	}
+
+	// objects such as street lamps light the tile at their top left corner
+	std::vector<int> affected;
+	getChunksInRegion(region, affected);
+	for (int chunk : affected)
+	{
+		for (std::size_t objectIndex : chunkObjects[chunk])
+		{
+			const WorldObject &object = objects[objectIndex];
+			unsigned char emission = (unsigned char) tileset->getLightEmission(object.type);
+			if (emission == 0)
+				continue;
+
+			sf::Vector2f pos = getObjectPosition(object);
+			sf::Vector2i tile((int) floor(pos.x), (int) floor(pos.y));
+			if (!region.contains(tile))
+				continue;
+
+			unsigned char &source = sources[(tile.x - region.left) + (tile.y - region.top) * region.width];
+			source = std::max(source, emission);
+		}
+	}
+
+	// only queue the chunks whose sources changed
+	for (int chunk : affected)
+	{
+		sf::IntRect changed;
+		if (!getChunkBounds(chunk).intersects(region, changed))
+			continue;
+
+		bool differs = false;
+		for (int y = changed.top; y < changed.top + changed.height; ++y)
+		{
+			for (int x = changed.left; x < changed.left + changed.width; ++x)
+			{
+				unsigned char source = sources[(x - region.left) + (y - region.top) * region.width];
+				differs |= lightSources[x + y * size.x] != source;
+				lightSources[x + y * size.x] = source;
+			}
+		}
+
+		if (!differs)
+			continue;
+
+		// merged with the waiting region of the same chunk, so that many
+		// small changes are spread together
+		auto waiting = std::find_if(dirtyLight.begin(), dirtyLight.end(), [this, chunk](const sf::IntRect &r)
+		{
+			return getChunkIndex({r.left, r.top}) == chunk;
+		});
+
+		if (waiting == dirtyLight.end())
+		{
+			dirtyLight.push_back(changed);
+			continue;
+		}
+
+		sf::IntRect &r = *waiting;
+		int right = std::max(r.left + r.width, changed.left + changed.width);
+		int bottom = std::max(r.top + r.height, changed.top + changed.height);
+		r.left = std::min(r.left, changed.left);
+		r.top = std::min(r.top, changed.top);
+		r.width = right - r.left;
+		r.height = bottom - r.top;
+	}
+}
+
+void WorldTerrain::spreadLight(std::vector<unsigned char> &levels, int width, int height)
+{
+	// forwards then backwards is enough for distances along the grid
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			int level = levels[x + y * width];
+			if (x > 0)
+				level = std::max(level, levels[x - 1 + y * width] - 1);
+			if (y > 0)
+				level = std::max(level, levels[x + (y - 1) * width] - 1);
+			levels[x + y * width] = (unsigned char) level;
+		}
+	}
+
+	for (int y = height - 1; y >= 0; --y)
+	{
+		for (int x = width - 1; x >= 0; --x)
+		{
+			int level = levels[x + y * width];
+			if (x < width - 1)
+				level = std::max(level, levels[x + 1 + y * width] - 1);
+			if (y < height - 1)
+				level = std::max(level, levels[x + (y + 1) * width] - 1);
+			levels[x + y * width] = (unsigned char) level;
+		}
+	}
+}
+
+void WorldTerrain::updateLighting(float ambient, const sf::FloatRect &visibleTiles)
+{
+	if (lightSources.empty())
+		return;
+
+	// collect finished light in order, stopping at the first still being spread
+	while (!lightJobs.empty() &&
+	       lightJobs.front().levels.wait_for(std::chrono::seconds(0)) != std::future_status::timeout)
+	{
+		LightJob &job = lightJobs.front();
+		const sf::IntRect &r = job.region;
+		std::vector<unsigned char> levels = job.levels.get();
+
+		for (int y = 0; y < r.height; ++y)
+			std::copy(levels.begin() + y * r.width, levels.begin() + (y + 1) * r.width,
+			          lightLevels.begin() + r.left + (r.top + y) * size.x);
+
+		// light reaches past the changed sources, but those tiles were
+		// already within the region handed to the worker
+		std::vector<int> affected;
+		getChunksInRegion(r, affected);
+		for (int chunk : affected)
+		{
+			auto built = chunks.find(chunk);
+			if (built != chunks.end())
+				built->second.lightStale = true;
+		}
+
+		lightJobs.pop_front();
+	}
+
+	// a chunk per worker, each with the sources close enough to reach it
+	bool parallel = workers != nullptr && Config::getBool("world.lighting.parallel-spread", true);
+	std::size_t maxJobs = workers != nullptr ? workers->getWorkerCount() : 1;
+
+	const int reach = Constants::maxLightLevel;
+	while (!dirtyLight.empty() && lightJobs.size() < maxJobs)
+	{
+		sf::IntRect changed = dirtyLight.front();
+		dirtyLight.pop_front();
+
+		// everything the changed sources reach, and everything reaching it
+		sf::IntRect region, window;
+		sf::IntRect(changed.left - reach, changed.top - reach, changed.width + 2 * reach, changed.height + 2 * reach)
+				.intersects({0, 0, size.x, size.y}, region);
+		sf::IntRect(region.left - reach, region.top - reach, region.width + 2 * reach, region.height + 2 * reach)
+				.intersects({0, 0, size.x, size.y}, window);
+
+		std::vector<unsigned char> sources(window.width * window.height);
+		for (int y = 0; y < window.height; ++y)
+		{
+			auto row = lightSources.begin() + window.left + (window.top + y) * size.x;
+			std::copy(row, row + window.width, sources.begin() + y * window.width);
+		}
+
+		auto spread = std::bind([region, window](std::vector<unsigned char> &levels) -> std::vector<unsigned char>
+		{
+			spreadLight(levels, window.width, window.height);
+
+			std::vector<unsigned char> out(region.width * region.height);
+			for (int y = 0; y < region.height; ++y)
+			{
+				auto row = levels.begin() + (region.left - window.left) + (region.top - window.top + y) * window.width;
+				std::copy(row, row + region.width, out.begin() + y * region.width);
+			}
+			return out;
+		}, std::move(sources));
+
+		// spread when collected if not in parallel
+		lightJobs.push_back(LightJob{region, parallel ? workers->submit(std::move(spread)) :
+		                                     std::async(std::launch::deferred, std::move(spread))});
+	}
+
+	// recolour a few chunks a frame, so the whole city doesn't at once at dusk
+	ambientStep = (int) round(std::max(0.f, std::min(1.f, ambient)) * ambientSteps);
+	int budget = Config::getInt("world.lighting.recolours-per-frame", 4);
+
+	auto recolour = [this, &budget](int index, TerrainChunk &chunk)
+	{
+		if (budget <= 0 || (!chunk.lightStale && chunk.ambientStep == ambientStep))
+			return;
+
+		colourChunk(index, chunk);
+		--budget;
+	};
+
+	// visible chunks first
+	sf::IntRect range = getChunkRange(visibleTiles);
+	for (int y = range.top; y < range.top + range.height; ++y)
+	{
+		for (int x = range.left; x < range.left + range.width; ++x)
+		{
+			auto chunk = chunks.find(x + y * chunkCount.x);
+			if (chunk != chunks.end())
+				recolour(chunk->first, chunk->second);
+		}
+	}
+
+	for (auto &pair : chunks)
+		recolour(pair.first, pair.second);
+}
+
+void WorldTerrain::colourChunk(int chunk, TerrainChunk &out) const
+{
+	sf::IntRect bounds = getChunkBounds(chunk);
+	const float ambient = (float) ambientStep / ambientSteps;
+
+	auto colourOf = [this, ambient](int x, int y) -> sf::Color
+	{
+		float light = lightLevels.empty() ? 0.f : (float) lightLevels[x + y * size.x] / Constants::maxLightLevel;
+
+		// lamplight is warmer than daylight
+		return sf::Color((sf::Uint8) (255 * std::max(ambient, light)),
+		                 (sf::Uint8) (255 * std::max(ambient, light * 0.9f)),
+		                 (sf::Uint8) (255 * std::max(ambient, light * 0.7f)));
+	};
+
+	std::vector<sf::Color> colours(bounds.width * bounds.height);
+	for (int y = 0; y < bounds.height; ++y)
+		for (int x = 0; x < bounds.width; ++x)
+			colours[x + y * bounds.width] = colourOf(bounds.left + x, bounds.top + y);
+
+	// every layer has a quad per tile, in the same order
+	sf::VertexArray *layers[] = {&out.tileVertices, &out.overLayerVertices};
+	for (sf::VertexArray *vertices : layers)
+	{
+		std::size_t quadCount = vertices->getVertexCount() / 4;
+		for (std::size_t quad = 0; quad < quadCount; ++quad)
+		{
+			const sf::Color &colour = colours[quad % colours.size()];
+			for (int i = 0; i < 4; ++i)
+				(*vertices)[quad * 4 + i].color = colour;
+		}
+	}
+
+	// objects by the tile under their centre, which may be outside the chunk
+	std::size_t objectQuadCount = out.objectVertices.getVertexCount() / 4;
+	for (std::size_t quad = 0; quad < objectQuadCount; ++quad)
+	{
+		sf::Vector2f centre;
+		for (int i = 0; i < 4; ++i)
+			centre += out.objectVertices[quad * 4 + i].position;
+		centre /= 4.f;
+
+		int x = std::max(0, std::min(size.x - 1, (int) floor(centre.x)));
+		int y = std::max(0, std::min(size.y - 1, (int) floor(centre.y)));
+		sf::Color colour = colourOf(x, y);
+		for (int i = 0; i < 4; ++i)
+			out.objectVertices[quad * 4 + i].color = colour;
+	}
+
+	out.ambientStep = ambientStep;
+	out.lightStale = false;
+}
+
+int WorldTerrain::getLightLevel(const sf::Vector2i &tile) const
+{
+	if (tile.x < 0 || tile.y < 0 || tile.x >= size.x || tile.y >= size.y)
+		error("Tile (%1%, %2%) is out of bounds", _str(tile.x), _str(tile.y));
+
+	return lightLevels.empty() ? 0 : lightLevels[tile.x + tile.y * size.x];
+}
+
+bool WorldTerrain::isLightSettled() const
+{
+	return dirtyLight.empty() && lightJobs.empty();
+}
@@ -232,12 +232,19 @@ WorldService::WorldLoader::LoadedWorld &WorldService::WorldLoader::loadWorld(con
 		WorldTerrain &terrain = terrainCache.emplace(
 				std::piecewise_construct,
 				std::forward_as_tuple(name),
-				std::forward_as_tuple(loadedWorld.world, loadedWorld.tmx.size)).first->second;
+				std::forward_as_tuple(loadedWorld.tmx.size)).first->second;
 		loadedWorld.world->setTerrain(terrain);
 		terrain.loadFromTileMap(loadedWorld.tmx, flippedTileGIDs);
 		Logger::popIndent();
 	}
 
+	// share already loaded terrain
+	else
+	{
+		Logger::logDebuggier(format("Sharing cached terrain for world '%1%'", name));
+		loadedWorld.world->setTerrain(cachedTerrain->second);
+	}
+
 	// find buildings and doors
 	auto buildingLayer = std::find_if(loadedWorld.tmx.layers.begin(), loadedWorld.tmx.layers.end(),
 	        [](const TMX::Layer &layer)
@@ -0,0 +1,190 @@
+#include <cmath>
+#include "service/locator.hpp"
+#include "service/config_service.hpp"
+#include "service/logging_service.hpp"
+#include "service/world_service.hpp"
+#include "service/entity_service.hpp"
+#include "service/camera_service.hpp"
+
+// tiles, at least as large as the usual watch radius
+const int DOOR_CELL_SIZE = 8;
+
+WorldService::WorldPrefetcher::WorldPrefetcher(WorldService *ws) : ws(ws)
+{
+}
+
+long long WorldService::WorldPrefetcher::getCellKey(int tileX, int tileY)
+{
+	int cellX = (int) floor((float) tileX / DOOR_CELL_SIZE);
+	int cellY = (int) floor((float) tileY / DOOR_CELL_SIZE);
+	return ((long long) cellX << 32) | (unsigned int) cellY;
+}
+
+void WorldService::WorldPrefetcher::discoverDoors(const WorldConnectionTable &connections)
+{
+	doors.clear();
+	for (auto &pair : connections)
+		doors[pair.first.world][getCellKey(pair.first.x, pair.first.y)].emplace_back(pair.first, pair.second);
+}
+
+void WorldService::WorldPrefetcher::tick()
+{
+	// load finished prefetches on the main thread
+	auto it = pending.begin();
+	while (it != pending.end())
+	{
+		if (it->second.map.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			++it;
+			continue;
+		}
+
+		CollisionMap *map = finish(it->first, it->second);
+		if (map != nullptr)
+		{
+			ws->getWorld(it->first)->load(map);
+			ws->activeWorlds.emplace(it->first, 0.f);
+		}
+		it = pending.erase(it);
+	}
+
+	EntityService *es = Locator::locate<EntityService>(false);
+	if (es == nullptr)
+		return;
+
+	float radius = Config::getFloat("world.prefetch.radius", 3.f);
+	float trackedRadius = Config::getFloat("world.prefetch.tracked-radius", 6.f);
+
+	CameraService *cs = Locator::locate<CameraService>(false);
+	PhysicsComponent *tracked = cs == nullptr ? nullptr : cs->getTrackedEntity();
+	if (tracked != nullptr)
+		watchEntity(tracked, trackedRadius);
+
+	for (EntityID e = 0; e < MAX_ENTITIES; ++e)
+	{
+		if (!es->hasComponent(e, COMPONENT_PHYSICS))
+			continue;
+
+		PhysicsComponent *phys = es->getComponent<PhysicsComponent>(e, COMPONENT_PHYSICS);
+		if (phys != tracked && !phys->isStopped())
+			watchEntity(phys, radius);
+	}
+}
+
+void WorldService::WorldPrefetcher::watchEntity(PhysicsComponent *phys, float radius)
+{
+	auto worldDoors = doors.find(phys->world);
+	if (worldDoors == doors.end())
+		return;
+
+	sf::Vector2f pos = phys->getTilePosition();
+	sf::Vector2f velocity = phys->getVelocity();
+
+	// only the cells the radius overlaps
+	int left = (int) floor((pos.x - radius) / DOOR_CELL_SIZE);
+	int right = (int) floor((pos.x + radius) / DOOR_CELL_SIZE);
+	int top = (int) floor((pos.y - radius) / DOOR_CELL_SIZE);
+	int bottom = (int) floor((pos.y + radius) / DOOR_CELL_SIZE);
+
+	for (int cellY = top; cellY <= bottom; ++cellY)
+	{
+		for (int cellX = left; cellX <= right; ++cellX)
+		{
+			auto cell = worldDoors->second.find(getCellKey(cellX * DOOR_CELL_SIZE, cellY * DOOR_CELL_SIZE));
+			if (cell == worldDoors->second.end())
+				continue;
+
+			for (const DoorConnection &door : cell->second)
+			{
+				World *destination = ws->getWorld(door.second.world);
+				if (destination == nullptr || destination->isLoaded())
+					continue;
+
+				sf::Vector2f toDoor(door.first.x + 0.5f - pos.x, door.first.y + 0.5f - pos.y);
+				float distanceSqrd = toDoor.x * toDoor.x + toDoor.y * toDoor.y;
+				if (distanceSqrd > radius * radius)
+					continue;
+
+				// only if heading towards it, or already on top of it
+				if (distanceSqrd > 1.f && toDoor.x * velocity.x + toDoor.y * velocity.y <= 0.f)
+					continue;
+
+				prefetch(door.second.world);
+			}
+		}
+	}
+}
+
+void WorldService::WorldPrefetcher::prefetch(WorldID id)
+{
+	if (pending.find(id) != pending.end())
+		return;
+
+	World *world = ws->getWorld(id);
+	if (world == nullptr || world->isLoaded())
+		return;
+
+	int maxPending = Config::getInt("world.prefetch.max-pending", 2);
+	if ((int) pending.size() >= maxPending)
+		return;
+
+	Logger::logDebuggier(format("Prefetching world %1% ('%2%')", _str(id), world->getName()));
+
+	// only reads the shared terrain and connection map of the world
+	PendingPrefetch &prefetch = pending[id];
+	prefetch.editGeneration = world->getTerrain()->getEditGeneration();
+	prefetch.map = ws->workers.submit([world]() -> CollisionMap *
+	{
+		CollisionMap *map = new CollisionMap(world);
+		map->createFixtures();
+		return map;
+	});
+}
+
+CollisionMap *WorldService::WorldPrefetcher::finish(WorldID id, PendingPrefetch &prefetch)
+{
+	CollisionMap *map = prefetch.map.get();
+
+	World *world = ws->getWorld(id);
+	if (world->getTerrain()->getEditGeneration() == prefetch.editGeneration)
+		return map;
+
+	Logger::logDebuggier(format("Discarding prefetch of world %1%, as its terrain has since been edited", _str(id)));
+	delete map;
+	return nullptr;
+}
+
+CollisionMap *WorldService::WorldPrefetcher::take(WorldID id)
+{
+	auto it = pending.find(id);
+	if (it == pending.end())
+		return nullptr;
+
+	CollisionMap *map = finish(id, it->second);
+	pending.erase(it);
+	return map;
+}
+
+void WorldService::WorldPrefetcher::cancelAll()
+{
+	for (auto &pair : pending)
+		delete pair.second.map.get();
+	pending.clear();
+}
+
+void WorldService::WorldPrefetcher::cancelTerrain(const WorldTerrain *terrain)
+{
+	auto it = pending.begin();
+	while (it != pending.end())
+	{
+		if (ws->getWorld(it->first)->getTerrain() != terrain)
+		{
+			++it;
+			continue;
+		}
+
+		Logger::logDebuggier(format("Cancelling prefetch of world %1%, as its terrain is being edited", _str(it->first)));
+		delete it->second.map.get();
+		it = pending.erase(it);
+	}
+}
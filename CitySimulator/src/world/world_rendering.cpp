@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <unordered_set>
 #include "world.hpp"
 #include "service/logging_service.hpp"
@@ -22,7 +23,7 @@ void Tileset::load()
 	generatePoints();
 }
 
-void Tileset::textureQuad(sf::Vertex *quad, const BlockType &blockType, int rotationAngle, int flipGID)
+void Tileset::textureQuad(sf::Vertex *quad, const BlockType &blockType, int rotationAngle, int flipGID) const
 {
 	int blockID;
 	auto flipResult = flippedBlockTypes.find(flipGID);
@@ -73,8 +74,27 @@ sf::Vector2u Tileset::getSize() const
 
 void Tileset::convertToTexture(const std::unordered_set<int> &flippedGIDs)
 {
+	// after every block type and animation frame
+	int firstFlipped = BLOCK_UNKNOWN;
+	for (const TileAnimation &animation : animations)
+		for (int frame : animation.frames)
+			firstFlipped = std::max(firstFlipped, frame + 1);
+
+	// flipped animated tiles need every frame flipped too
+	std::unordered_set<int> allFlippedGIDs(flippedGIDs);
+	for (int flippedGID : flippedGIDs)
+	{
+		std::bitset<3> flips;
+		int animation = getAnimationIndex(TMX::stripFlip(flippedGID, flips));
+		if (animation == -1)
+			continue;
+
+		for (int frame : animations[animation].frames)
+			allFlippedGIDs.insert(getFrameFlipGID(flippedGID, frame));
+	}
+
 	// resize image
-	int totalBlockTypes = BLOCK_UNKNOWN + flippedGIDs.size();
+	int totalBlockTypes = firstFlipped + allFlippedGIDs.size();
 	int rowsRequired = totalBlockTypes / size.x;
 
 	if (totalBlockTypes % size.x != 0)
@@ -90,8 +110,8 @@ void Tileset::convertToTexture(const std::unordered_set<int> &flippedGIDs)
 	generatePoints();
 
 	// render flipped blocktypes
-	int currentBlockType(BLOCK_UNKNOWN);
-	for (int flippedGID : flippedGIDs)
+	int currentBlockType(firstFlipped);
+	for (int flippedGID : allFlippedGIDs)
 	{
 		std::bitset<3> flips;
 		int blockType(TMX::stripFlip(flippedGID, flips));
@@ -117,6 +137,34 @@ void Tileset::convertToTexture(const std::unordered_set<int> &flippedGIDs)
 		++currentBlockType;
 	}
 
+	// for drawing tiles as single pixels
+	averageColours.resize(totalBlockTypes);
+	for (int blockType = 0; blockType < totalBlockTypes; ++blockType)
+	{
+		sf::IntRect rect = getTileRect(blockType);
+		unsigned int r = 0, g = 0, b = 0, count = 0;
+
+		for (int y = rect.top; y < rect.top + rect.height; ++y)
+		{
+			for (int x = rect.left; x < rect.left + rect.width; ++x)
+			{
+				sf::Color pixel = newImage.getPixel(x, y);
+				if (pixel.a == 0)
+					continue;
+
+				r += pixel.r;
+				g += pixel.g;
+				b += pixel.b;
+				++count;
+			}
+		}
+
+		if (count != 0)
+			averageColours[blockType] = sf::Color(r / count, g / count, b / count);
+		else
+			averageColours[blockType] = sf::Color::Transparent;
+	}
+
 	// write to texture
 	if (!texture.loadFromImage(newImage))
 		throw std::runtime_error("Could not render tileset");
@@ -136,6 +184,71 @@ sf::IntRect Tileset::getTileRect(unsigned blockType)
 	                   Constants::tilesetResolution);
 }
 
+sf::Color Tileset::getAverageColour(unsigned blockType) const
+{
+	if (blockType >= averageColours.size())
+		return sf::Color::Transparent;
+
+	return averageColours[blockType];
+}
+
+void Tileset::addAnimation(BlockType blockType, const std::vector<int> &frames, float frameDuration)
+{
+	if (converted)
+		error("Cannot add animation of block type %1% after the tileset has been converted", _str(blockType));
+	if (frames.empty() || frameDuration <= 0.f)
+		error("Invalid animation of block type %1%", _str(blockType));
+
+	for (int frame : frames)
+		if (frame < 0 || frame >= (int) (size.x * size.y))
+			error("Animation frame %1% of block type %2% is outside of the tileset", _str(frame), _str(blockType));
+
+	if (animationIndices.size() <= (std::size_t) blockType)
+		animationIndices.resize(blockType + 1, -1);
+	if (animationIndices[blockType] != -1)
+		error("Block type %1% is already animated", _str(blockType));
+
+	animationIndices[blockType] = animations.size();
+	animations.push_back({blockType, frames, frameDuration});
+}
+
+int Tileset::getAnimationIndex(unsigned blockType) const
+{
+	return blockType < animationIndices.size() ? animationIndices[blockType] : -1;
+}
+
+std::size_t Tileset::getAnimationCount() const
+{
+	return animations.size();
+}
+
+int Tileset::getAnimationFrame(int animation, float time) const
+{
+	const TileAnimation &anim = animations[animation];
+	std::size_t frame = (std::size_t) (time / anim.frameDuration) % anim.frames.size();
+	return anim.frames[frame];
+}
+
+int Tileset::getFrameFlipGID(int flipGID, int frame)
+{
+	return frame | (flipGID & (TMX::HORIZONTAL | TMX::VERTICAL));
+}
+
+void Tileset::setLightEmission(BlockType blockType, int intensity)
+{
+	if (intensity < 0 || intensity > Constants::maxLightLevel)
+		error("Invalid light intensity %1% of block type %2%", _str(intensity), _str(blockType));
+
+	if (lightEmissions.size() <= (std::size_t) blockType)
+		lightEmissions.resize(blockType + 1, 0);
+	lightEmissions[blockType] = (unsigned char) intensity;
+}
+
+int Tileset::getLightEmission(unsigned blockType) const
+{
+	return blockType < lightEmissions.size() ? lightEmissions[blockType] : 0;
+}
+
 void Tileset::createTileImage(sf::Image *image, unsigned blockType)
 {
 	if (converted)
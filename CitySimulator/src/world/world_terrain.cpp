@@ -1,5 +1,9 @@
+#include <algorithm>
+#include <future>
+#include <functional>
 #include "world.hpp"
 #include "service/logging_service.hpp"
+#include "service/config_service.hpp"
 
 bool isCollidable(BlockType blockType)
 {
@@ -59,40 +63,37 @@ bool isOverLayer(LayerType layerType)
 	return layerType == LAYER_OVERTERRAIN;
 }
 
-WorldTerrain::WorldTerrain(World *container, const sf::Vector2i &size) : 
-	BaseWorld(container), collisionMap(container), size(size)
+WorldTerrain::WorldTerrain(const sf::Vector2i &size) 
+: tileset(nullptr), tmx(nullptr), workers(nullptr), collisionOutlines(false), editGeneration(0), tileLayerCount(0), overLayerCount(0),
+  ambientStep(ambientSteps), size(size)
 {
-	tileVertices.setPrimitiveType(sf::Quads);
-	overLayerVertices.setPrimitiveType(sf::Quads);
+	chunkCount.x = (size.x + Constants::chunkSize - 1) / Constants::chunkSize;
+	chunkCount.y = (size.y + Constants::chunkSize - 1) / Constants::chunkSize;
+	chunkObjects.resize(chunkCount.x * chunkCount.y);
+
+	int streamThreshold = Config::getInt("world.chunks.stream-threshold", 256);
+	streamed = size.x > streamThreshold || size.y > streamThreshold;
 }
 
-int WorldTerrain::getBlockIndex(const sf::Vector2i &pos, LayerType layerType)
+WorldTerrain::~WorldTerrain()
 {
-	int index = (pos.x + pos.y * size.x);
-	index += getDepth(layerType) * size.x * size.y;
-	index *= 4;
-
-	return index;
+	// workers read the tiles, which are destroyed with this
+	for (ChunkJob &job : chunkJobs)
+		job.built.wait();
 }
 
-
-int WorldTerrain::getVertexIndex(const sf::Vector2i &pos, LayerType layerType)
+int WorldTerrain::getTileIndex(const sf::Vector2i &pos, LayerType layerType) const
 {
-	int index = (pos.x + pos.y * size.x);
-	int depth = getDepth(layerType);
-	if (isOverLayer(layerType))
-	{
-		int diff = tileLayerCount - overLayerCount;
-		depth -= diff;
-	}
+	if (pos.x < 0 || pos.y < 0 || pos.x >= size.x || pos.y >= size.y)
+		error("Tile (%1%, %2%) is out of bounds", _str(pos.x), _str(pos.y));
 
-	index += depth * size.x * size.y;
-	index *= 4;
+	auto layer = tileLayerIndices.find(layerType);
+	if (layer == tileLayerIndices.end())
+		error("Cannot get tile in invalid layer of type %1%", _str(layerType));
 
-	return index;
+	return pos.x + pos.y * size.x + layer->second.first * size.x * size.y;
 }
 
-
 void WorldTerrain::rotateObject(sf::Vertex *quad, float degrees, const sf::Vector2f &pos)
 {
 	sf::Vector2f origin(pos.x, pos.y + 1);
@@ -129,65 +130,62 @@ void WorldTerrain::positionVertices(sf::Vertex *quad, const sf::Vector2f &pos, i
 	quad[3].position = sf::Vector2f(pos.x, pos.y + delta);
 }
 
-int WorldTerrain::getDepth(LayerType layerType) const
-{
-	auto it = layerDepths.find(layerType);
-	if (it == layerDepths.end())
-		error("Cannot get depth for invalid layer of type %d", _str(layerType));
-	return it->second;
-}
-
-
-sf::VertexArray &WorldTerrain::getVertices(LayerType layerType)
+void WorldTerrain::resizeTiles()
 {
-	return isOverLayer(layerType) ? overLayerVertices : tileVertices;
-}
-
-void WorldTerrain::resizeVertices()
-{
-	const int sizeMultiplier = size.x * size.y * 4;
-
-	blockTypes.resize(tileLayerCount * sizeMultiplier);
-
-	tileVertices.resize((tileLayerCount - overLayerCount) * sizeMultiplier);
-	overLayerVertices.resize(overLayerCount * sizeMultiplier);
+	tiles.resize(tileLayerCount * size.x * size.y);
 }
 
 void WorldTerrain::setBlockType(const sf::Vector2i &pos, BlockType blockType, LayerType layer, int rotationAngle,
                                 int flipGID)
 {
-	int vertexIndex = getVertexIndex(pos, layer);
-	sf::VertexArray &vertices = getVertices(layer);
-	sf::Vertex *quad = &vertices[vertexIndex];
-
-	positionVertices(quad, pos, 1);
-	tileset->textureQuad(quad, blockType, rotationAngle, flipGID);
-
-	blockTypes[getBlockIndex(pos, layer)] = blockType;
+	TileData &tile = tiles[getTileIndex(pos, layer)];
+	int chunkIndex = getChunkIndex(pos);
+	cancelChunkBuild(chunkIndex);
+
+	unsigned char oldBlockType = tile.blockType;
+	tile.blockType = static_cast<unsigned char>(blockType);
+	tile.rotation = static_cast<short>(rotationAngle);
+	tile.flipGID = flipGID;
+
+	// such as a window turning on
+	if (tileset != nullptr && tileset->getLightEmission(oldBlockType) != tileset->getLightEmission(blockType))
+		refreshLightSources({pos.x, pos.y, 1, 1});
+
+	// update in place if built
+	auto chunk = chunks.find(chunkIndex);
+	if (chunk == chunks.end())
+		return;
+
+	// rebuilt instead, to update the animated tile lists
+	if (tileset->getAnimationIndex(oldBlockType) != -1 || tileset->getAnimationIndex(blockType) != -1)
+	{
+		buildChunk(chunkIndex, chunk->second);
+		colourChunk(chunkIndex, chunk->second);
+	}
+	else
+	{
+		textureTile(getChunkQuad(chunk->second, getChunkBounds(chunkIndex), pos, layer), pos, tile);
+		chunk->second.lightStale = true;
+	}
 }
 
 BlockType WorldTerrain::getBlockType(const sf::Vector2i &tile, LayerType layer)
 {
-	return blockTypes.at(getBlockIndex(tile, layer));
+	return static_cast<BlockType>(tiles[getTileIndex(tile, layer)].blockType);
 }
 
 void WorldTerrain::addObject(const sf::Vector2f &pos, BlockType blockType, float rotationAngle, int flipGID)
 {
-	std::vector<sf::Vertex> quad(4);
-	sf::Vector2f adjustedPos = sf::Vector2f(pos.x / Constants::tilesetResolution,
-	                                        (pos.y - Constants::tilesetResolution) / Constants::tilesetResolution);
-
-	positionVertices(&quad[0], adjustedPos, 1);
-	tileset->textureQuad(&quad[0], blockType, 0, flipGID);
-
-	if (rotationAngle != 0)
-		rotateObject(&quad[0], rotationAngle, adjustedPos);
+	objects.emplace_back(blockType, rotationAngle, Utils::toTile(pos), flipGID);
 
-	sf::VertexArray &vertices = getVertices(LAYER_OBJECTS);
-	for (int i = 0; i < 4; ++i)
-		vertices.append(quad[i]);
+	sf::Vector2f objectPos = getObjectPosition(objects.back());
+	int chunk = getChunkIndex(sf::Vector2i((int) floor(objectPos.x), (int) floor(objectPos.y)));
+	chunkObjects[chunk].push_back(objects.size() - 1);
+}
 
-	objects.emplace_back(blockType, rotationAngle, Utils::toTile(pos));
+sf::Vector2f WorldTerrain::getObjectPosition(const WorldObject &object)
+{
+	return sf::Vector2f(object.tilePos.x * Constants::scale, object.tilePos.y * Constants::scale - 1);
 }
 
 const std::vector<WorldObject> &WorldTerrain::getObjects() const
@@ -205,6 +203,7 @@ void WorldTerrain::discoverLayers(std::vector<TMX::Layer> &tmxLayers)
 	int depth = 0;
 	tileLayerCount = 0;
 	overLayerCount = 0;
+	tileLayerIndices.clear();
 
 	auto layerIt = tmxLayers.cbegin();
 	while (layerIt != tmxLayers.cend())
@@ -228,9 +227,14 @@ void WorldTerrain::discoverLayers(std::vector<TMX::Layer> &tmxLayers)
 		}
 
 		if (isTileLayer(layerType))
+		{
+			int drawIndex = isOverLayer(layerType) ? overLayerCount : tileLayerCount - overLayerCount;
+			tileLayerIndices[layerType] = std::make_pair(tileLayerCount, drawIndex);
+
 			++tileLayerCount;
-		if (isOverLayer(layerType))
-			++overLayerCount;
+			if (isOverLayer(layerType))
+				++overLayerCount;
+		}
 
 		layerDepths.insert({layerType, depth});
 		Logger::logDebuggier(format("Found layer type %1% at depth %2%", _str(layerType), _str(depth)));
@@ -258,9 +262,10 @@ void WorldTerrain::discoverFlippedTiles(const std::vector<TMX::Layer> &layers, s
 	}
 }
 
-void WorldTerrain::applyTiles(Tileset &tileset)
+void WorldTerrain::applyTiles(Tileset &tileset, WorkerPool &workers)
 {
 	this->tileset = &tileset;
+	this->workers = &workers;
 
 	auto &layers = tmx->layers;
 	for (const TMX::Layer &layer : layers)
@@ -300,17 +305,343 @@ void WorldTerrain::applyTiles(Tileset &tileset)
 	}
 
 	tmx = nullptr;
+
+	// spread by workers once drawn
+	lightSources.assign(size.x * size.y, 0);
+	lightLevels.assign(size.x * size.y, 0);
+	refreshLightSources({0, 0, size.x, size.y});
+
+	// for when zoomed too far out to draw chunks
+	bakeOverview({0, 0, size.x, size.y});
+
+	// small enough to keep fully built
+	if (!streamed)
+	{
+		std::vector<int> all(chunkCount.x * chunkCount.y);
+		for (std::size_t chunk = 0; chunk < all.size(); ++chunk)
+			all[chunk] = chunk;
+
+		buildChunks(all);
+	}
 }
 
-void WorldTerrain::loadBlockData()
+void WorldTerrain::buildChunks(const std::vector<int> &indices)
 {
-	collisionMap.load();
+	// insert on this thread first, so workers only fill in existing chunks
+	std::vector<std::pair<int, TerrainChunk *>> jobs;
+	jobs.reserve(indices.size());
+	for (int index : indices)
+	{
+		cancelChunkBuild(index);
+
+		auto inserted = chunks.emplace(index, TerrainChunk());
+		TerrainChunk *chunk = &inserted.first->second;
+		if (inserted.second)
+		{
+			chunkUsage.push_front(index);
+			chunk->usage = chunkUsage.begin();
+		}
+
+		if (std::find_if(jobs.begin(), jobs.end(), [chunk](const std::pair<int, TerrainChunk *> &job)
+		{
+			return job.second == chunk;
+		}) == jobs.end())
+			jobs.emplace_back(index, chunk);
+	}
+
+	// this thread helps too
+	std::size_t workerCount = workers == nullptr ? 1 : workers->getWorkerCount() + 1;
+	workerCount = std::min(workerCount, jobs.size());
+	if (workerCount <= 1 || !Config::getBool("world.chunks.parallel-build", true))
+	{
+		for (auto &job : jobs)
+		{
+			buildChunk(job.first, *job.second);
+			colourChunk(job.first, *job.second);
+		}
+		return;
+	}
+
+	// interleaved, as chunks at the edges of the world are smaller
+	auto buildEvery = [this, &jobs, workerCount](std::size_t first)
+	{
+		for (std::size_t i = first; i < jobs.size(); i += workerCount)
+			buildChunk(jobs[i].first, *jobs[i].second);
+	};
+
+	std::vector<std::future<void>> builds;
+	for (std::size_t worker = 1; worker < workerCount; ++worker)
+		builds.push_back(workers->submit(std::bind(buildEvery, worker)));
+
+	buildEvery(0);
+
+	for (std::future<void> &build : builds)
+		build.get();
+
+	// light levels are only ever read on this thread
+	for (auto &job : jobs)
+		colourChunk(job.first, *job.second);
 }
 
-void WorldTerrain::render(sf::RenderTarget &target, sf::RenderStates &states, bool overLayers) const
+void WorldTerrain::cancelChunkBuild(int chunk)
+{
+	auto job = std::find_if(chunkJobs.begin(), chunkJobs.end(), [chunk](const ChunkJob &j)
+	{
+		return j.chunk == chunk;
+	});
+
+	if (job == chunkJobs.end())
+		return;
+
+	job->built.wait();
+	chunkJobs.erase(job);
+}
+
+void WorldTerrain::render(sf::RenderTarget &target, sf::RenderStates &states, const sf::FloatRect &visibleTiles,
+                          bool overLayers) const
 {
 	states.texture = tileset->getTexture();
-	target.draw(overLayers ? overLayerVertices : tileVertices, states);
+
+	sf::IntRect range = getChunkRange(visibleTiles);
+	for (int y = range.top; y < range.top + range.height; ++y)
+	{
+		for (int x = range.left; x < range.left + range.width; ++x)
+		{
+			auto chunk = chunks.find(x + y * chunkCount.x);
+			if (chunk != chunks.end())
+				target.draw(overLayers ? chunk->second.overLayerVertices : chunk->second.tileVertices, states);
+		}
+	}
+
+	if (overLayers)
+		return;
+
+	// objects are drawn over all terrain, as they may overlap chunk edges
+	for (int y = range.top; y < range.top + range.height; ++y)
+	{
+		for (int x = range.left; x < range.left + range.width; ++x)
+		{
+			auto chunk = chunks.find(x + y * chunkCount.x);
+			if (chunk != chunks.end())
+				target.draw(chunk->second.objectVertices, states);
+		}
+	}
+}
+
+void WorldTerrain::animateTiles(float time, const sf::FloatRect &visibleTiles)
+{
+	std::size_t animationCount = tileset->getAnimationCount();
+	if (animationCount == 0)
+		return;
+
+	// once per animation, rather than per tile
+	std::vector<int> frames(animationCount);
+	for (std::size_t animation = 0; animation < animationCount; ++animation)
+		frames[animation] = tileset->getAnimationFrame(animation, time);
+
+	// hidden chunks catch up when they come into view
+	sf::IntRect range = getChunkRange(visibleTiles);
+	for (int y = range.top; y < range.top + range.height; ++y)
+	{
+		for (int x = range.left; x < range.left + range.width; ++x)
+		{
+			auto chunk = chunks.find(x + y * chunkCount.x);
+			if (chunk == chunks.end())
+				continue;
+
+			TerrainChunk &built = chunk->second;
+			for (std::size_t animation = 0; animation < animationCount; ++animation)
+			{
+				int frame = frames[animation];
+				if (built.animatedFrames[animation] == frame)
+					continue;
+
+				built.animatedFrames[animation] = frame;
+				for (const TerrainChunk::AnimatedQuad &animated : built.animatedQuads[animation])
+				{
+					sf::VertexArray &vertices = animated.overLayer ? built.overLayerVertices : built.tileVertices;
+					tileset->textureQuad(&vertices[animated.vertex], static_cast<BlockType>(frame), animated.rotation,
+					                     Tileset::getFrameFlipGID(animated.flipGID, frame));
+				}
+			}
+		}
+	}
+}
+
+void WorldTerrain::renderOverview(sf::RenderTarget &target, sf::RenderStates &states,
+                                  const sf::FloatRect &visibleTiles) const
+{
+	if (overviewTextures.empty())
+		return;
+
+	// the finest level with no more texels than screen pixels
+	float tilesPerPixel = visibleTiles.width / target.getSize().x;
+	std::size_t level = 0;
+	while (level + 1 < overviewTextures.size() && (float) (1 << level) < tilesPerPixel)
+		++level;
+
+	// coarser instead if too large for the graphics card
+	while (level + 1 < overviewTextures.size() && overviewTextures[level].getSize().x == 0)
+		++level;
+
+	const sf::Texture &texture = overviewTextures[level];
+	if (texture.getSize().x == 0)
+		return;
+
+	sf::FloatRect region;
+	if (!visibleTiles.intersects(sf::FloatRect(0, 0, size.x, size.y), region))
+		return;
+
+	const float scale = 1.f / (1 << level);
+	float right = region.left + region.width;
+	float bottom = region.top + region.height;
+
+	sf::Vertex quad[4];
+	quad[0] = sf::Vertex(sf::Vector2f(region.left, region.top), sf::Vector2f(region.left, region.top) * scale);
+	quad[1] = sf::Vertex(sf::Vector2f(right, region.top), sf::Vector2f(right, region.top) * scale);
+	quad[2] = sf::Vertex(sf::Vector2f(right, bottom), sf::Vector2f(right, bottom) * scale);
+	quad[3] = sf::Vertex(sf::Vector2f(region.left, bottom), sf::Vector2f(region.left, bottom) * scale);
+
+	states.texture = &texture;
+	target.draw(quad, 4, sf::Quads, states);
+}
+
+void WorldTerrain::bakeOverview(const sf::IntRect &tiles)
+{
+	// created on first bake, at load
+	if (overviewImages.empty())
+	{
+		int levelCount = std::max(1, Config::getInt("world.lod.overview-levels", 3));
+		for (int level = 0; level < levelCount; ++level)
+		{
+			sf::Vector2u levelSize((size.x + (1 << level) - 1) >> level, (size.y + (1 << level) - 1) >> level);
+			overviewImages.emplace_back();
+			overviewImages.back().create(levelSize.x, levelSize.y, sf::Color::Transparent);
+
+			if (levelSize.x == 1 && levelSize.y == 1)
+				break;
+		}
+
+		overviewTextures.resize(overviewImages.size());
+		for (std::size_t level = 0; level < overviewImages.size(); ++level)
+		{
+			sf::Vector2u levelSize = overviewImages[level].getSize();
+			unsigned int maxSize = sf::Texture::getMaximumSize();
+
+			// left empty, so a coarser level is drawn instead
+			if (levelSize.x > maxSize || levelSize.y > maxSize)
+				continue;
+
+			if (!overviewTextures[level].create(levelSize.x, levelSize.y))
+				error("Could not create overview level %1%", _str(level));
+			overviewTextures[level].setSmooth(false);
+		}
+	}
+
+	sf::IntRect region;
+	if (!tiles.intersects({0, 0, size.x, size.y}, region))
+		return;
+
+	// layers in draw order, so later ones cover earlier ones
+	std::vector<std::pair<int, int>> layers;
+	for (auto &layer : tileLayerIndices)
+		layers.emplace_back(layerDepths.at(layer.first), layer.second.first);
+	std::sort(layers.begin(), layers.end());
+
+	// one pixel per tile, coloured by the topmost tile that is not blank
+	sf::Image &finest = overviewImages[0];
+	for (int y = region.top; y < region.top + region.height; ++y)
+	{
+		for (int x = region.left; x < region.left + region.width; ++x)
+		{
+			sf::Color colour = sf::Color::Transparent;
+			for (auto &layer : layers)
+			{
+				const TileData &tile = this->tiles[layer.second * size.x * size.y + x + y * size.x];
+				if (tile.blockType == BLOCK_BLANK)
+					continue;
+
+				sf::Color average = tileset->getAverageColour(tile.blockType);
+				if (average.a != 0)
+					colour = average;
+			}
+
+			finest.setPixel(x, y, colour);
+		}
+	}
+
+	// each coarser level averages 2x2 pixels of the one before
+	for (std::size_t level = 0; level < overviewImages.size(); ++level)
+	{
+		sf::Image &image = overviewImages[level];
+		sf::Vector2u imageSize = image.getSize();
+
+		if (level != 0)
+		{
+			int right = (region.left + region.width + 1) / 2;
+			int bottom = (region.top + region.height + 1) / 2;
+			region.left /= 2;
+			region.top /= 2;
+			region.width = right - region.left;
+			region.height = bottom - region.top;
+
+			const sf::Image &finer = overviewImages[level - 1];
+			sf::Vector2u finerSize = finer.getSize();
+
+			for (int y = region.top; y < region.top + region.height; ++y)
+			{
+				for (int x = region.left; x < region.left + region.width; ++x)
+				{
+					unsigned int r = 0, g = 0, b = 0, a = 0, count = 0;
+					for (unsigned int fy = y * 2; fy < std::min(finerSize.y, (unsigned int) y * 2 + 2); ++fy)
+					{
+						for (unsigned int fx = x * 2; fx < std::min(finerSize.x, (unsigned int) x * 2 + 2); ++fx)
+						{
+							sf::Color pixel = finer.getPixel(fx, fy);
+							r += pixel.r * pixel.a;
+							g += pixel.g * pixel.a;
+							b += pixel.b * pixel.a;
+							a += pixel.a;
+							++count;
+						}
+					}
+
+					if (a == 0)
+						image.setPixel(x, y, sf::Color::Transparent);
+					else
+						image.setPixel(x, y, sf::Color(r / a, g / a, b / a, a / count));
+				}
+			}
+		}
+
+		sf::Texture &texture = overviewTextures[level];
+		if (texture.getSize().x == 0)
+			continue;
+
+		// only the changed rows of the region
+		std::vector<sf::Uint8> pixels(region.width * region.height * 4);
+		const sf::Uint8 *source = image.getPixelsPtr();
+		for (int y = 0; y < region.height; ++y)
+		{
+			const sf::Uint8 *row = source + ((region.top + y) * imageSize.x + region.left) * 4;
+			std::copy(row, row + region.width * 4, pixels.begin() + y * region.width * 4);
+		}
+		texture.update(pixels.data(), (unsigned int) region.width, (unsigned int) region.height,
+		               (unsigned int) region.left, (unsigned int) region.top);
+	}
+}
+
+const sf::Image &WorldTerrain::getOverview(std::size_t level) const
+{
+	if (level >= overviewImages.size())
+		error("Overview level %1% has not been baked", _str(level));
+
+	return overviewImages[level];
+}
+
+std::size_t WorldTerrain::getOverviewLevelCount() const
+{
+	return overviewImages.size();
 }
 
 void WorldTerrain::loadFromTileMap(TMX::TileMap &tileMap, std::unordered_set<int> &flippedGIDs)
@@ -323,15 +654,226 @@ void WorldTerrain::loadFromTileMap(TMX::TileMap &tileMap, std::unordered_set<int
 	Logger::logDebug(format("Discovered %1% tile layer(s), of which %2% are overterrain",
 				_str(tileLayerCount), _str(overLayerCount)));
 
-	// resize vertex array to accommodate for layer count
-	resizeVertices();
+	// resize tile data to accommodate for layer count
+	resizeTiles();
 
 	// collect any gids that need flipping
 	discoverFlippedTiles(tileMap.layers, flippedGIDs);
 }
 
+sf::Vector2i WorldTerrain::getSize() const
+{
+	return size;
+}
+
+sf::Vector2i WorldTerrain::getChunkCount() const
+{
+	return chunkCount;
+}
+
+int WorldTerrain::getChunkIndex(const sf::Vector2i &tile) const
+{
+	int x = std::max(0, std::min(tile.x, size.x - 1)) / Constants::chunkSize;
+	int y = std::max(0, std::min(tile.y, size.y - 1)) / Constants::chunkSize;
+	return x + y * chunkCount.x;
+}
+
+sf::IntRect WorldTerrain::getChunkBounds(int chunk) const
+{
+	int left = (chunk % chunkCount.x) * Constants::chunkSize;
+	int top = (chunk / chunkCount.x) * Constants::chunkSize;
+	return sf::IntRect(left, top,
+	                   std::min(Constants::chunkSize, size.x - left),
+	                   std::min(Constants::chunkSize, size.y - top));
+}
+
+sf::IntRect WorldTerrain::getChunkRange(const sf::FloatRect &tiles) const
+{
+	int from = getChunkIndex(sf::Vector2i((int) floor(tiles.left), (int) floor(tiles.top)));
+	int to = getChunkIndex(sf::Vector2i((int) floor(tiles.left + tiles.width), (int) floor(tiles.top + tiles.height)));
+
+	sf::Vector2i fromChunk(from % chunkCount.x, from / chunkCount.x);
+	sf::Vector2i toChunk(to % chunkCount.x, to / chunkCount.x);
+	return sf::IntRect(fromChunk, toChunk - fromChunk + sf::Vector2i(1, 1));
+}
+
+bool WorldTerrain::isStreamed() const
+{
+	return streamed;
+}
+
+std::size_t WorldTerrain::getResidentChunkCount() const
+{
+	return chunks.size();
+}
+
+sf::Vertex *WorldTerrain::getChunkQuad(TerrainChunk &chunk, const sf::IntRect &bounds, const sf::Vector2i &pos,
+                                       LayerType layer) const
+{
+	int drawIndex = tileLayerIndices.at(layer).second;
+	int index = (pos.x - bounds.left) + (pos.y - bounds.top) * bounds.width;
+	index += drawIndex * bounds.width * bounds.height;
+
+	sf::VertexArray &vertices = isOverLayer(layer) ? chunk.overLayerVertices : chunk.tileVertices;
+	return &vertices[index * 4];
+}
+
+void WorldTerrain::textureTile(sf::Vertex *quad, const sf::Vector2i &pos, const TileData &tile) const
+{
+	if (tile.blockType == BLOCK_BLANK)
+	{
+		for (int i = 0; i < 4; ++i)
+			quad[i] = sf::Vertex();
+		return;
+	}
+
+	positionVertices(quad, pos, 1);
+	tileset->textureQuad(quad, static_cast<BlockType>(tile.blockType), tile.rotation, tile.flipGID);
+}
 
-CollisionMap *WorldTerrain::getCollisionMap()
+void WorldTerrain::buildChunk(int chunk, TerrainChunk &out) const
 {
-	return &collisionMap;
+	sf::IntRect bounds = getChunkBounds(chunk);
+	const int verticesPerLayer = bounds.width * bounds.height * 4;
+
+	out.tileVertices.setPrimitiveType(sf::Quads);
+	out.tileVertices.resize((tileLayerCount - overLayerCount) * verticesPerLayer);
+	out.overLayerVertices.setPrimitiveType(sf::Quads);
+	out.overLayerVertices.resize(overLayerCount * verticesPerLayer);
+	out.objectVertices.setPrimitiveType(sf::Quads);
+	out.objectVertices.clear();
+
+	// textured with their current frame when next animated
+	out.animatedQuads.assign(tileset->getAnimationCount(), std::vector<TerrainChunk::AnimatedQuad>());
+	out.animatedFrames.assign(tileset->getAnimationCount(), -1);
+
+	// tiles
+	sf::Vector2i pos;
+	for (auto &layer : tileLayerIndices)
+	{
+		const TileData *layerTiles = &tiles[layer.second.first * size.x * size.y];
+		bool overLayer = isOverLayer(layer.first);
+		const sf::Vertex *first = &(overLayer ? out.overLayerVertices : out.tileVertices)[0];
+
+		for (pos.y = bounds.top; pos.y < bounds.top + bounds.height; ++pos.y)
+		{
+			for (pos.x = bounds.left; pos.x < bounds.left + bounds.width; ++pos.x)
+			{
+				const TileData &tile = layerTiles[pos.x + pos.y * size.x];
+				sf::Vertex *quad = getChunkQuad(out, bounds, pos, layer.first);
+				textureTile(quad, pos, tile);
+
+				int animation = tileset->getAnimationIndex(tile.blockType);
+				if (animation != -1)
+					out.animatedQuads[animation].push_back({(unsigned int) (quad - first), tile.rotation, tile.flipGID,
+					                                        overLayer});
+			}
+		}
+	}
+
+	// objects
+	sf::Vertex quad[4];
+	for (std::size_t objectIndex : chunkObjects[chunk])
+	{
+		const WorldObject &object = objects[objectIndex];
+		sf::Vector2f objectPos = getObjectPosition(object);
+
+		positionVertices(quad, objectPos, 1);
+		tileset->textureQuad(quad, object.type, 0, object.flipGID);
+
+		if (object.rotation != 0)
+			rotateObject(quad, object.rotation, objectPos);
+
+		for (int i = 0; i < 4; ++i)
+			out.objectVertices.append(quad[i]);
+	}
+}
+
+void WorldTerrain::streamChunks(const sf::FloatRect &visibleTiles)
+{
+	// everything is already built
+	if (!streamed)
+		return;
+
+	// adopt whatever workers have finished, without waiting for the rest
+	for (auto job = chunkJobs.begin(); job != chunkJobs.end();)
+	{
+		if (job->built.wait_for(std::chrono::seconds(0)) == std::future_status::timeout)
+		{
+			++job;
+			continue;
+		}
+
+		auto inserted = chunks.emplace(job->chunk, job->built.get());
+		if (inserted.second)
+		{
+			TerrainChunk &chunk = inserted.first->second;
+			chunkUsage.push_front(job->chunk);
+			chunk.usage = chunkUsage.begin();
+
+			// light levels are only ever read on this thread
+			colourChunk(job->chunk, chunk);
+		}
+
+		job = chunkJobs.erase(job);
+	}
+
+	int loadsPerFrame = Config::getInt("world.chunks.loads-per-frame", 4);
+	std::size_t budget = (std::size_t) Config::getInt("world.chunks.render-budget", 64);
+	bool parallel = workers != nullptr && Config::getBool("world.chunks.parallel-build", true);
+
+	// visible chunks first, then a ring around them to hide popping in
+	sf::FloatRect margin(visibleTiles.left - Constants::chunkSize, visibleTiles.top - Constants::chunkSize,
+	                     visibleTiles.width + 2 * Constants::chunkSize,
+	                     visibleTiles.height + 2 * Constants::chunkSize);
+	const sf::IntRect ranges[] = {getChunkRange(visibleTiles), getChunkRange(margin)};
+
+	int loads = 0;
+	for (const sf::IntRect &range : ranges)
+	{
+		for (int y = range.top; y < range.top + range.height; ++y)
+		{
+			for (int x = range.left; x < range.left + range.width; ++x)
+			{
+				int index = x + y * chunkCount.x;
+				auto chunk = chunks.find(index);
+
+				if (chunk != chunks.end())
+				{
+					chunkUsage.splice(chunkUsage.begin(), chunkUsage, chunk->second.usage);
+					continue;
+				}
+
+				bool building = std::find_if(chunkJobs.begin(), chunkJobs.end(), [index](const ChunkJob &job)
+				{
+					return job.chunk == index;
+				}) != chunkJobs.end();
+
+				if (building || loads >= loadsPerFrame)
+					continue;
+
+				auto build = [this, index]() -> TerrainChunk
+				{
+					TerrainChunk built;
+					buildChunk(index, built);
+					return built;
+				};
+
+				// adopted on a later frame, once finished, or built then if not in parallel
+				chunkJobs.push_back(ChunkJob{index, parallel ? workers->submit(build) :
+				                                    std::async(std::launch::deferred, build)});
+				++loads;
+			}
+		}
+	}
+
+	// never evict what is in use
+	const sf::IntRect &inUse = ranges[1];
+	budget = std::max(budget, (std::size_t) (inUse.width * inUse.height));
+
+	while (chunks.size() > budget)
+	{
+		chunks.erase(chunkUsage.back());
+		chunkUsage.pop_back();
+	}
 }
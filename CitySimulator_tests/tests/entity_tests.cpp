@@ -42,6 +42,59 @@ TEST_F(EntityTests, EntityLifeCycle)
 	EXPECT_EQ(es->getEntityCount(), 0);
 }
 
+TEST_F(EntityTests, Recycling)
+{
+	EntityService *es = Locator::locate<EntityService>();
+
+	EXPECT_EQ(es->recycleEntity(ENTITY_HUMAN, "Test Man", nullptr, {0, 0}), nullptr);
+
+	EntityIdentifier *entity = es->createEntity(ENTITY_HUMAN, "Test Man");
+	EntityID e = entity->id;
+	es->addRenderComponent(*entity, "Test Man", 0.2f, DIRECTION_EAST, false);
+	es->despawnEntity(e);
+	EXPECT_FALSE(es->isAlive(e));
+	EXPECT_EQ(es->getEntityCount(), 0);
+
+	// its slot is held back
+	EntityID other = es->createEntity();
+	EXPECT_NE(other, e);
+
+	// wrong type or prototype
+	EXPECT_EQ(es->recycleEntity(ENTITY_VEHICLE, "Test Man", nullptr, {0, 0}), nullptr);
+	EXPECT_EQ(es->recycleEntity(ENTITY_HUMAN, "Other Man", nullptr, {0, 0}), nullptr);
+
+	EntityIdentifier *recycled = es->recycleEntity(ENTITY_HUMAN, "Test Man", nullptr, {0, 0});
+	ASSERT_NE(recycled, nullptr);
+	EXPECT_EQ(recycled->id, e);
+	EXPECT_EQ(es->getPrototype(e), "Test Man");
+	EXPECT_TRUE(es->hasComponent(e, COMPONENT_RENDER));
+	EXPECT_TRUE(es->isAlive(e));
+
+	EXPECT_FLOAT_EQ(es->getRecycleHitRate(), 1.f / 4.f);
+}
+
+TEST_F(EntityTests, Sleeping)
+{
+	EntityService *es = Locator::locate<EntityService>();
+
+	EntityIdentifier *entity = es->createEntity(ENTITY_HUMAN);
+	EntityID e = entity->id;
+	es->addRenderComponent(*entity, "Test Man", 0.2f, DIRECTION_EAST, false);
+	EXPECT_FALSE(es->isAsleep(e));
+
+	es->setAsleep(e, true);
+	EXPECT_TRUE(es->isAsleep(e));
+	EXPECT_EQ(es->getAsleepCount(), 1);
+
+	// new components wake it
+	es->addRenderComponent(*entity, "Test Man", 0.2f, DIRECTION_EAST, false);
+	EXPECT_FALSE(es->isAsleep(e));
+
+	es->setAsleep(e, true);
+	es->killEntity(e);
+	EXPECT_EQ(es->getAsleepCount(), 0);
+}
+
 TEST_F(EntityTests, Sprite)
 {
 	AnimationService *as = Locator::locate<AnimationService>();
@@ -52,3 +105,76 @@ TEST_F(EntityTests, Sprite)
 
 	EXPECT_NO_THROW(Animator(anim, 0.25f));
 }
+
+TEST_F(EntityTests, SpriteBatching)
+{
+	Animation *anim = Locator::locate<AnimationService>()->getAnimation(ENTITY_HUMAN, "Test Man");
+	ASSERT_NE(anim, nullptr);
+
+	Animator a(anim, 0.25f);
+	Animator b(anim, 0.25f);
+	EXPECT_EQ(a.getTexture(), b.getTexture());
+
+	// both entities in a single batch
+	sf::VertexArray batch(sf::Quads);
+	a.appendQuad(batch, sf::Vector2f(0, 0), 2.f);
+	b.appendQuad(batch, sf::Vector2f(10, 20), 2.f);
+	ASSERT_EQ(batch.getVertexCount(), 8u);
+
+	EXPECT_EQ(batch[4].position, sf::Vector2f(10, 20));
+	EXPECT_EQ(batch[2].position.x - batch[0].position.x, (batch[2].texCoords.x - batch[0].texCoords.x) * 2.f);
+}
+
+TEST_F(EntityTests, DepthOrder)
+{
+	std::vector<float> y = {3.f, 1.f, 2.f, 1.f};
+	auto getDepth = [&y](EntityID e)
+	{
+		return y[e];
+	};
+
+	DepthOrder order;
+	order.update({0, 1, 2, 3, 1}, getDepth);
+	EXPECT_EQ(order.getOrder(), std::vector<EntityID>({1, 3, 2, 0}));
+
+	// nothing moved
+	EXPECT_EQ(order.update({3, 2, 1, 0}, getDepth), 0);
+
+	// one entity walks to the front, and another leaves
+	y[0] = 0.5f;
+	EXPECT_EQ(order.update({0, 1, 2}, getDepth), 2);
+	EXPECT_EQ(order.getOrder(), std::vector<EntityID>({0, 1, 2}));
+}
+
+TEST_F(EntityTests, AnimationClock)
+{
+	Animation *anim = Locator::locate<AnimationService>()->getAnimation(ENTITY_HUMAN, "Test Man");
+	ASSERT_NE(anim, nullptr);
+	ASSERT_GT(anim->frameCount, 1u);
+	EXPECT_EQ(anim->frames.size(), anim->sequenceCount * anim->frameCount);
+
+	Animator a(anim, 0.25f, DIRECTION_SOUTH, true);
+	Animator b(anim, 0.25f, DIRECTION_SOUTH, false);
+	EXPECT_EQ(a.getCurrentFrame(), 0u);
+
+	Animator::tickClock(0.3f);
+	EXPECT_EQ(a.getCurrentFrame(), 1u);
+	EXPECT_EQ(b.getCurrentFrame(), 0u);
+
+	// started later, so out of phase
+	b.setPlaying(true);
+	Animator::tickClock(0.1f);
+	EXPECT_EQ(a.getCurrentFrame(), 1u);
+	EXPECT_EQ(b.getCurrentFrame(), 0u);
+
+	// paused on the current frame
+	a.setPlaying(false);
+	Animator::tickClock(anim->frameCount * 0.25f);
+	EXPECT_EQ(a.getCurrentFrame(), 1u);
+
+	// turning keeps the frame
+	a.turn(DIRECTION_NORTH, false);
+	EXPECT_EQ(a.getCurrentFrame(), 1u);
+	a.turn(DIRECTION_EAST, true);
+	EXPECT_EQ(a.getCurrentFrame(), 0u);
+}
@@ -1,5 +1,9 @@
+#include <atomic>
+#include <chrono>
 #include <boost/filesystem.hpp>
 #include "utils.hpp"
+#include "SFMLDebugDraw.h"
+#include "worker_pool.hpp"
 #include "test_helpers.hpp"
 
 TEST(UtilTests, Format)
@@ -76,4 +80,120 @@ TEST(UtilTests, FileSearching)
 	EXPECT_ANY_THROW(Utils::searchForFile("", dir));
 
 	EXPECT_ANY_THROW(Utils::searchForFile("robert", ""));
-}
\ No newline at end of file
+}
+
+TEST(UtilTests, DirectionFromVectors)
+{
+	// including diagonals and zero, where rounding matters
+	std::vector<float> x = {0.f, 1.f, -1.f, 1.f, -1.f, 0.f, 0.f, 3.f, -2.f};
+	std::vector<float> y = {0.f, 1.f, 1.f, -1.f, -1.f, 2.f, -2.f, 0.5f, 0.1f};
+
+	while (x.size() < 1000)
+	{
+		x.push_back(Utils::random<float>(-5.f, 5.f));
+		y.push_back(Utils::random<float>(-5.f, 5.f));
+	}
+
+	std::vector<unsigned char> batch(x.size());
+	Direction::fromVectors(x.data(), y.data(), x.size(), batch.data());
+
+	for (std::size_t i = 0; i < x.size(); ++i)
+		ASSERT_EQ(batch[i], Direction::fromAngle(atan2(y[i], x[i]) * Math::radToDeg)) << x[i] << ", " << y[i];
+}
+
+TEST(UtilTests, DirectionFromVectorsBenchmark)
+{
+	std::vector<float> x, y;
+	for (std::size_t count : {1000, 10000, 100000})
+	{
+		while (x.size() < count)
+		{
+			x.push_back(Utils::random<float>(-5.f, 5.f));
+			y.push_back(Utils::random<float>(-5.f, 5.f));
+		}
+
+		std::vector<unsigned char> batch(count);
+		auto start = std::chrono::steady_clock::now();
+		Direction::fromVectors(x.data(), y.data(), count, batch.data());
+		auto batchTime = std::chrono::steady_clock::now() - start;
+
+		std::vector<unsigned char> single(count);
+		start = std::chrono::steady_clock::now();
+		for (std::size_t i = 0; i < count; ++i)
+			single[i] = Direction::fromAngle(atan2(y[i], x[i]) * Math::radToDeg);
+		auto singleTime = std::chrono::steady_clock::now() - start;
+
+		ASSERT_EQ(batch, single);
+
+		// recorded rather than asserted, as timings vary between machines
+		using std::chrono::microseconds;
+		RecordProperty(format("us-batch-%1%", _str(count)),
+		               (int) std::chrono::duration_cast<microseconds>(batchTime).count());
+		RecordProperty(format("us-atan2-%1%", _str(count)),
+		               (int) std::chrono::duration_cast<microseconds>(singleTime).count());
+	}
+}
+
+TEST(UtilTests, BatchedDebugDraw)
+{
+	sf::RenderWindow window;
+	SFMLDebugDraw draw(window);
+
+	b2Vec2 box[] = {b2Vec2(0.f, 0.f), b2Vec2(1.f, 0.f), b2Vec2(1.f, 1.f), b2Vec2(0.f, 1.f)};
+	draw.DrawSolidPolygon(box, 4, b2Color(1.f, 1.f, 1.f));
+	draw.DrawSegment(box[0], box[2], b2Color(1.f, 1.f, 1.f));
+
+	// two triangles, and four edges and a segment
+	EXPECT_EQ(draw.GetTriangleVertexCount(), 6u);
+	EXPECT_EQ(draw.GetLineVertexCount(), 10u);
+
+	// only fixtures in the region
+	b2World world(b2Vec2(0.f, 0.f));
+	b2BodyDef bodyDef;
+	b2PolygonShape shape;
+	shape.SetAsBox(0.5f, 0.5f);
+	for (float x : {0.f, 10.f})
+	{
+		bodyDef.position.Set(x, 0.f);
+		world.CreateBody(&bodyDef)->CreateFixture(&shape, 0.f);
+	}
+
+	SFMLDebugDraw culled(window);
+	b2AABB region;
+	region.lowerBound.Set(-1.f, -1.f);
+	region.upperBound.Set(1.f, 1.f);
+	culled.DrawFixtures(world, region);
+	EXPECT_EQ(culled.GetTriangleVertexCount(), 6u);
+}
+
+TEST(UtilTests, WorkerPool)
+{
+	WorkerPool pool(2);
+	EXPECT_EQ(pool.getWorkerCount(), 2u);
+
+	std::atomic<int> count(0);
+	std::vector<std::future<void>> jobs;
+	for (int i = 0; i < 100; ++i)
+		jobs.push_back(pool.submit([&count]()
+		{
+			++count;
+		}));
+
+	for (std::future<void> &job : jobs)
+		job.get();
+	EXPECT_EQ(count, 100);
+
+	// results are passed on too
+	std::future<int> result = pool.submit([]()
+	{
+		return 7;
+	});
+	EXPECT_EQ(result.get(), 7);
+
+	// exceptions are passed on to whoever waits
+	std::future<void> failed = pool.submit([]()
+	{
+		error("Failed job");
+	});
+	EXPECT_THROW(failed.get(), std::runtime_error);
+}
@@ -61,6 +61,274 @@ TEST_F(SimpleWorldTest, LayerLoad)
 
 }
 
+TEST_F(SimpleWorldTest, Chunks)
+{
+	// small worlds are a single, fully built chunk
+	WorldTerrain *terrain = world->getTerrain();
+	EXPECT_EQ(terrain->getChunkCount(), sf::Vector2i(1, 1));
+	EXPECT_FALSE(terrain->isStreamed());
+	EXPECT_EQ(terrain->getResidentChunkCount(), 1);
+	EXPECT_TRUE(world->getCollisionMap()->isChunkLoaded(0));
+
+	WorldTerrain large(sf::Vector2i(130, 70));
+	EXPECT_EQ(large.getChunkCount(), sf::Vector2i(3, 2));
+	EXPECT_EQ(large.getChunkIndex({129, 69}), 5);
+	EXPECT_EQ(large.getChunkBounds(5), sf::IntRect(128, 64, 2, 6));
+
+	// clamped to the world
+	EXPECT_EQ(large.getChunkIndex({-5, 500}), 3);
+}
+
+TEST_F(SimpleWorldTest, GreedyMeshing)
+{
+	std::vector<sf::IntRect> water;
+	for (const CollisionRect &rect : world->getTerrain()->getCollisionRects(0))
+		if (rect.blockType == BLOCK_WATER)
+			water.push_back(sf::IntRect(Utils::scaleToBox2D(rect.rect))); // in tiles
+
+	// in scan order, each grown right then down
+	ASSERT_EQ(water.size(), 3);
+	EXPECT_EQ(water[0], sf::IntRect(3, 0, 3, 3));
+	EXPECT_EQ(water[1], sf::IntRect(5, 4, 1, 2));
+	EXPECT_EQ(water[2], sf::IntRect(3, 5, 2, 1));
+}
+
+TEST_F(SimpleWorldTest, CollisionOutlines)
+{
+	// a 3x3 block of water, and an L shape
+	const std::vector<CollisionOutline> &outlines = world->getTerrain()->getCollisionOutlines(0);
+	ASSERT_EQ(outlines.size(), 2);
+	EXPECT_EQ(outlines[0].size(), 4);
+	EXPECT_EQ(outlines[1].size(), 6);
+
+	EXPECT_EQ(outlines[0][0], sf::Vector2f(3, 0));
+
+	// boxes by default, one proxy each
+	CollisionMap *collisionMap = world->getCollisionMap();
+	EXPECT_EQ(collisionMap->getStaticFixtureCount(), 11);
+	EXPECT_EQ(collisionMap->getStaticProxyCount(), 11);
+}
+
+TEST_F(SimpleWorldTest, RebuildRegion)
+{
+	CollisionMap *collisionMap = world->getCollisionMap();
+	int fixtures = collisionMap->getStaticFixtureCount();
+
+	// a lone new pond
+	world->getTerrain()->setBlockType({0, 0}, BLOCK_WATER);
+	CollisionRebuildCost cost = ws->rebuildRegion(world->getID(), {0, 0, 1, 1});
+
+	EXPECT_EQ(cost.chunks, 1);
+	EXPECT_EQ(cost.fixturesRemoved, fixtures);
+	EXPECT_EQ(cost.fixturesAdded, fixtures + 1);
+	EXPECT_EQ(collisionMap->getStaticFixtureCount(), fixtures + 1);
+	EXPECT_EQ(collisionMap->getStaticBodyCount(), 1);
+}
+
+TEST_F(SimpleWorldTest, ParkedBodies)
+{
+	CollisionMap *collisionMap = world->getCollisionMap();
+	b2World *bw = world->getBox2DWorld();
+
+	b2BodyDef def;
+	def.type = b2_dynamicBody;
+	b2Body *body = bw->CreateBody(&def);
+	b2PolygonShape box;
+	box.SetAsBox(0.25f, 0.25f);
+	body->CreateFixture(&box, 1.f);
+	EXPECT_FALSE(world->isEmpty());
+
+	// parked bodies are kept, but do not keep the world alive
+	collisionMap->parkEntityBody(body);
+	EXPECT_EQ(collisionMap->getParkedBodyCount(), 1);
+	EXPECT_FALSE(body->IsActive());
+	EXPECT_TRUE(world->isEmpty());
+
+	BodyData data;
+	data.type = BODYDATA_ENTITY;
+	b2Filter filter;
+	filter.categoryBits = COLLISION_ENTITY;
+	b2Body *reused = collisionMap->unparkEntityBody(&data, filter, {2.f, 3.f});
+	ASSERT_EQ(reused, body);
+	EXPECT_TRUE(reused->IsActive());
+	EXPECT_EQ(reused->GetFixtureList()->GetUserData(), &data);
+	EXPECT_EQ(reused->GetFixtureList()->GetFilterData().categoryBits, COLLISION_ENTITY);
+	EXPECT_FLOAT_EQ(reused->GetPosition().x, 2.f);
+	EXPECT_FLOAT_EQ(reused->GetPosition().y, 3.f);
+
+	EXPECT_EQ(collisionMap->unparkEntityBody(&data, filter, {0.f, 0.f}), nullptr);
+	bw->DestroyBody(reused);
+}
+
+TEST_F(SimpleWorldTest, AgentGrid)
+{
+	AgentGrid *grid = world->getCollisionMap()->getAgentGrid();
+	std::vector<std::pair<EntityID, sf::Vector2i>> doors;
+	const float feet = Constants::entityScalef / 2 * 0.75f;
+
+	// walking north into the lake
+	AgentID walker = grid->addAgent(0, {4.5f, 3.f}, true);
+	grid->setVelocity(walker, {0.f, -2.f});
+	for (int i = 0; i < 20; ++i)
+		grid->step(0.05f, doors);
+
+	sf::Vector2f pos = grid->getPosition(walker);
+	EXPECT_FLOAT_EQ(pos.x, 4.5f);
+	EXPECT_GE(pos.y + feet - grid->getRadius(), 2.999f);
+	EXPECT_FLOAT_EQ(grid->getVelocity(walker).y, 0.f);
+	EXPECT_FALSE(world->isEmpty());
+
+	// overlapping agents are pushed apart
+	AgentID other = grid->addAgent(1, pos, true);
+	grid->step(0.05f, doors);
+	sf::Vector2f offset = grid->getPosition(other) - grid->getPosition(walker);
+	EXPECT_GE(Math::length(offset), grid->getRadius() * 2 - 0.001f);
+
+	EXPECT_TRUE(doors.empty());
+
+	grid->removeAgent(walker);
+	grid->removeAgent(other);
+	EXPECT_EQ(grid->getAgentCount(), 0);
+	EXPECT_TRUE(world->isEmpty());
+}
+
+TEST_F(SimpleWorldTest, EntityQuery)
+{
+	CollisionMap *map = world->getCollisionMap();
+	AgentGrid *grid = map->getAgentGrid();
+	std::vector<std::pair<EntityID, sf::Vector2i>> doors;
+
+	AgentID agents[4];
+	for (int i = 0; i < 4; ++i)
+		agents[i] = grid->addAgent(i, {0.5f + i, 3.5f}, true);
+
+	// before and after the first step, as the hash is only then built
+	for (int steps = 0; steps < 2; ++steps)
+	{
+		sf::Vector2f pos = grid->getPosition(agents[2]);
+
+		std::vector<EntityID> found;
+		map->queryEntities({pos.x - 0.1f, pos.y - 0.1f, 0.2f, 0.2f}, found);
+		ASSERT_EQ(found.size(), 1u);
+		EXPECT_EQ(found[0], 2);
+
+		found.clear();
+		map->queryEntities({-10.f, -10.f, 30.f, 30.f}, found);
+		EXPECT_EQ(found.size(), 4u);
+
+		grid->step(0.05f, doors);
+	}
+
+	for (AgentID agent : agents)
+		grid->removeAgent(agent);
+}
+
+TEST_F(SimpleWorldTest, BuildChunks)
+{
+	WorldTerrain *terrain = world->getTerrain();
+	ASSERT_FALSE(terrain->isStreamed());
+	EXPECT_EQ(terrain->getResidentChunkCount(), 1u);
+
+	// duplicates are only built once
+	EXPECT_NO_THROW(terrain->buildChunks({0, 0, 0}));
+	EXPECT_EQ(terrain->getResidentChunkCount(), 1u);
+}
+
+TEST_F(SimpleWorldTest, TerrainOverview)
+{
+	WorldTerrain *terrain = world->getTerrain();
+
+	// baked at load, halving until a single pixel
+	ASSERT_EQ(terrain->getOverviewLevelCount(), 3u);
+	EXPECT_EQ(terrain->getOverview(0).getSize(), sf::Vector2u(6, 6));
+	EXPECT_EQ(terrain->getOverview(1).getSize(), sf::Vector2u(3, 3));
+	EXPECT_EQ(terrain->getOverview(2).getSize(), sf::Vector2u(2, 2));
+	EXPECT_ANY_THROW(terrain->getOverview(3));
+
+	// same tiles, so same colour, in both levels
+	const sf::Image &overview = terrain->getOverview(0);
+	EXPECT_NE(overview.getPixel(4, 0).a, 0);
+	EXPECT_EQ(overview.getPixel(4, 0), overview.getPixel(5, 1));
+	EXPECT_EQ(terrain->getOverview(1).getPixel(2, 0), overview.getPixel(4, 0));
+
+	// edits are rebaked into every level
+	terrain->setBlockType({4, 0}, BLOCK_BLANK);
+	terrain->bakeOverview({4, 0, 1, 1});
+	EXPECT_EQ(overview.getPixel(4, 0).a, 0);
+	EXPECT_GT(terrain->getOverview(1).getPixel(2, 0).a, 0);
+	EXPECT_LT(terrain->getOverview(1).getPixel(2, 0).a, overview.getPixel(5, 1).a);
+}
+
+TEST_F(SimpleWorldTest, Lightmap)
+{
+	WorldTerrain *terrain = world->getTerrain();
+	sf::FloatRect visibleTiles(0, 0, 6, 6);
+
+	// no light sources
+	while (!terrain->isLightSettled())
+		terrain->updateLighting(0.f, visibleTiles);
+	EXPECT_EQ(terrain->getLightLevel({0, 0}), 0);
+
+	// windows are lit as configured, falling by one per tile
+	terrain->setBlockType({2, 2}, BLOCK_BUILDING_WINDOW_ON);
+	EXPECT_FALSE(terrain->isLightSettled());
+	while (!terrain->isLightSettled())
+		terrain->updateLighting(0.f, visibleTiles);
+
+	EXPECT_EQ(terrain->getLightLevel({2, 2}), 6);
+	EXPECT_EQ(terrain->getLightLevel({3, 2}), 5);
+	EXPECT_EQ(terrain->getLightLevel({0, 0}), 2);
+	EXPECT_EQ(terrain->getLightLevel({5, 5}), 0);
+
+	// and go out again
+	terrain->setBlockType({2, 2}, BLOCK_BUILDING_WINDOW_OFF);
+	while (!terrain->isLightSettled())
+		terrain->updateLighting(0.f, visibleTiles);
+	EXPECT_EQ(terrain->getLightLevel({2, 2}), 0);
+	EXPECT_THROW(terrain->getLightLevel({6, 0}), std::runtime_error);
+}
+
+struct RecordingTerrainListener : TerrainEditListener
+{
+	std::vector<sf::IntRect> regions;
+
+	void onTerrainEdit(World *, const sf::IntRect &region) override
+	{
+		regions.push_back(region);
+	}
+};
+
+TEST_F(SimpleWorldTest, TerrainEdit)
+{
+	RecordingTerrainListener listener;
+	ws->registerTerrainListener(&listener);
+
+	WorldTerrain *terrain = world->getTerrain();
+	int fixtures = world->getCollisionMap()->getStaticFixtureCount();
+
+	TerrainEdit edit(world->getID());
+	edit.setBlockType({0, 0}, BLOCK_WATER)
+		.setBlockType({0, 5}, BLOCK_WATER);
+	ws->commitTerrainEdit(edit);
+
+	// one region for the single chunk
+	ASSERT_EQ(listener.regions.size(), 1);
+	EXPECT_EQ(listener.regions[0], sf::IntRect(0, 0, 1, 6));
+
+	EXPECT_EQ(terrain->getBlockType({0, 0}), BLOCK_WATER);
+	EXPECT_EQ(terrain->getBlockType({0, 5}), BLOCK_WATER);
+	EXPECT_EQ(world->getCollisionMap()->getStaticFixtureCount(), fixtures + 2);
+
+	// all or nothing
+	TerrainEdit bad(world->getID());
+	bad.setBlockType({1, 1}, BLOCK_SAND)
+		.setBlockType({500, 0}, BLOCK_SAND);
+	EXPECT_ANY_THROW(ws->commitTerrainEdit(bad));
+	EXPECT_EQ(terrain->getBlockType({1, 1}), BLOCK_DIRT);
+
+	ws->unregisterTerrainListener(&listener);
+}
+
 TEST_F(SimpleWorldTest, CollisionBoxes)
 {
 	b2World *bw = world->getBox2DWorld();
@@ -174,6 +442,149 @@ TEST_F(ConnectionLookupTest, ConnectionLookup)
 				{"hub", "single-test", "none-test", "none-double-test", "none-double-test"}));
 }
 
+TEST_F(ConnectionLookupTest, SharedTerrain)
+{
+	// multiple-test connects to two instances of none-double-test
+	std::vector<World *> instances;
+	for (WorldID id = 0; ws->getWorld(id) != nullptr; ++id)
+	{
+		World *w = ws->getWorld(id);
+		if (w->getName() == "none-double-test")
+			instances.push_back(w);
+	}
+
+	ASSERT_EQ(instances.size(), 2);
+
+	// instantiated lazily
+	EXPECT_FALSE(instances[0]->isLoaded());
+	EXPECT_FALSE(instances[1]->isLoaded());
+	EXPECT_TRUE(instances[0]->isEmpty());
+	EXPECT_ANY_THROW(instances[0]->getBox2DWorld());
+
+	ws->instantiateWorld(instances[0]->getID());
+	ws->instantiateWorld(instances[1]->getID());
+	ASSERT_TRUE(instances[0]->isLoaded());
+	ASSERT_TRUE(instances[1]->isLoaded());
+
+	// terrain is shared
+	EXPECT_EQ(instances[0]->getTerrain(), instances[1]->getTerrain());
+
+	// physics is not
+	EXPECT_NE(instances[0]->getBox2DWorld(), instances[1]->getBox2DWorld());
+	EXPECT_NE(instances[0]->getCollisionMap(), instances[1]->getCollisionMap());
+	EXPECT_EQ(instances[0]->getBox2DWorld()->GetBodyCount(), 1);
+	EXPECT_EQ(instances[1]->getBox2DWorld()->GetBodyCount(), 1);
+}
+
+TEST_F(ConnectionLookupTest, ParallelStep)
+{
+	World *worlds[] = {ws->getMainWorld(), ws->instantiateWorld(1)};
+	b2Body *bodies[2];
+
+	for (int i = 0; i < 2; ++i)
+	{
+		b2BodyDef def;
+		def.type = b2_dynamicBody;
+		def.position.Set(2.f, 2.f);
+		bodies[i] = worlds[i]->getBox2DWorld()->CreateBody(&def);
+
+		b2PolygonShape box;
+		box.SetAsBox(0.25f, 0.25f);
+		bodies[i]->CreateFixture(&box, 1.f);
+		bodies[i]->SetLinearVelocity(b2Vec2(1.f, 0.f));
+	}
+
+	// both step, whether or not concurrently
+	ws->tickActiveWorlds(0.1f);
+
+	for (int i = 0; i < 2; ++i)
+	{
+		EXPECT_GT(bodies[i]->GetPosition().x, 2.f);
+		worlds[i]->getBox2DWorld()->DestroyBody(bodies[i]);
+	}
+}
+
+TEST_F(ConnectionLookupTest, IdleEviction)
+{
+	World *interior = ws->instantiateWorld(1);
+	ASSERT_TRUE(interior->isLoaded());
+	ASSERT_TRUE(ws->getMainWorld()->isLoaded());
+
+	// still within timeout
+	ws->tickActiveWorlds(1.f);
+	EXPECT_TRUE(interior->isLoaded());
+
+	// empty for too long
+	ws->tickActiveWorlds(Config::getFloat("world.interior-idle-timeout", 30.f));
+	EXPECT_FALSE(interior->isLoaded());
+
+	// connections and doors stay resident
+	Location out;
+	EXPECT_TRUE(ws->getConnectionDestination({0, 1, 3}, out));
+	EXPECT_EQ(out.world, interior->getID());
+
+	// outside world is never evicted
+	EXPECT_TRUE(ws->getMainWorld()->isLoaded());
+}
+
+std::size_t countFixtures(b2World *bw)
+{
+	std::size_t count = 0;
+	for (b2Body *body = bw->GetBodyList(); body; body = body->GetNext())
+		for (b2Fixture *f = body->GetFixtureList(); f; f = f->GetNext())
+			count++;
+	return count;
+}
+
+TEST_F(ConnectionLookupTest, Prefetch)
+{
+	World *interior = ws->getWorld(1);
+	ASSERT_NE(interior, nullptr);
+	ASSERT_FALSE(interior->isLoaded());
+
+	// instantiating waits for the prefetch to finish
+	ws->prefetchWorld(1);
+	ws->instantiateWorld(1);
+	ASSERT_TRUE(interior->isLoaded());
+
+	b2World *bw = interior->getBox2DWorld();
+	EXPECT_EQ(bw->GetBodyCount(), 1);
+	std::size_t prefetchedFixtures = countFixtures(bw);
+
+	// same as loading on the main thread
+	ws->tickActiveWorlds(Config::getFloat("world.interior-idle-timeout", 30.f));
+	ASSERT_FALSE(interior->isLoaded());
+	ws->instantiateWorld(1);
+	EXPECT_EQ(countFixtures(interior->getBox2DWorld()), prefetchedFixtures);
+
+	// prefetching a loaded world does nothing
+	ws->prefetchWorld(1);
+	ws->tickActiveWorlds(0.f);
+	EXPECT_TRUE(interior->isLoaded());
+}
+
+TEST_F(ConnectionLookupTest, PrefetchTerrainEdit)
+{
+	World *interior = ws->getWorld(1);
+	ASSERT_FALSE(interior->isLoaded());
+
+	// editing cancels the prefetch, rather than racing it
+	ws->prefetchWorld(1);
+	TerrainEdit edit(interior->getID());
+	edit.setBlockType({1, 1}, BLOCK_WATER);
+	ws->commitTerrainEdit(edit);
+
+	ws->instantiateWorld(1);
+	ASSERT_TRUE(interior->isLoaded());
+	std::size_t fixtures = countFixtures(interior->getBox2DWorld());
+
+	// same as loading the edited terrain on the main thread
+	ws->tickActiveWorlds(Config::getFloat("world.interior-idle-timeout", 30.f));
+	ASSERT_FALSE(interior->isLoaded());
+	ws->instantiateWorld(1);
+	EXPECT_EQ(countFixtures(interior->getBox2DWorld()), fixtures);
+}
+
 BuildingID findFirstBuilding(BuildingConnectionMap *bm, BuildingID max)
 {
 	for (int id = 0; id <= max; ++id)
@@ -264,6 +675,11 @@ TEST_F(BuildingConnectionMapTest, DoorBlockData)
 	BlockData &blockData = bodyData->blockData;
 	ASSERT_EQ(blockData.blockDataType, BLOCKDATA_DOOR);
 
+	// only entities can trigger doors
+	EXPECT_TRUE(doorFixture->IsSensor());
+	EXPECT_EQ(doorFixture->GetFilterData().categoryBits, COLLISION_DOOR);
+	EXPECT_EQ(doorFixture->GetFilterData().maskBits, COLLISION_ENTITY);
+
 	boost::optional<std::pair<BuildingID, DoorID>> buildingAndDoor;
 	world->getBuildingConnectionMap()->getBuildingByOutsideDoorTile(tile, buildingAndDoor);
 
@@ -271,6 +687,18 @@ TEST_F(BuildingConnectionMapTest, DoorBlockData)
 
 	Building *building = world->getBuildingConnectionMap()->getBuildingByID(buildingAndDoor->first);
 	ASSERT_NE(building, nullptr);
+
+	// rebuilding reuses pooled block data
+	const BodyDataPool &pool = world->getCollisionMap()->getBodyDataPool();
+	int inUse = pool.getInUseCount();
+	int capacity = pool.getCapacity();
+	EXPECT_GT(inUse, 0);
+
+	for (int i = 0; i < 3; ++i)
+		ws->rebuildRegion(world->getID(), {tile.x - 1, tile.y, 1, 1});
+
+	EXPECT_EQ(pool.getInUseCount(), inUse);
+	EXPECT_EQ(pool.getCapacity(), capacity);
 }
 
 TEST(WorldUtils, BlockInteractivity)
@@ -285,3 +713,30 @@ TEST(WorldUtils, BlockInteractivity)
 	ASSERT_EQ(getInteractivity(BLOCK_ENTRANCE_MAT), INTERACTIVITY_INTERACT);
 	ASSERT_EQ(getInteractivity(BLOCK_DIRT), INTERACTIVTY_NONE);
 }
+
+TEST(TilesetTests, TileAnimations)
+{
+	Tileset tileset("data/test_tileset.png");
+	tileset.load();
+
+	tileset.addAnimation(BLOCK_WATER, {BLOCK_WATER, 30, 31}, 0.5f);
+	EXPECT_THROW(tileset.addAnimation(BLOCK_WATER, {30}, 0.5f), std::runtime_error);
+	EXPECT_THROW(tileset.addAnimation(BLOCK_GRASS, {1000}, 0.5f), std::runtime_error);
+
+	EXPECT_EQ(tileset.getAnimationIndex(BLOCK_WATER), 0);
+	EXPECT_EQ(tileset.getAnimationIndex(BLOCK_GRASS), -1);
+
+	EXPECT_EQ(tileset.getAnimationFrame(0, 0.f), BLOCK_WATER);
+	EXPECT_EQ(tileset.getAnimationFrame(0, 0.6f), 30);
+	EXPECT_EQ(tileset.getAnimationFrame(0, 1.6f), BLOCK_WATER);
+
+	// every frame of a flipped animated tile is flipped too
+	int flippedWater = BLOCK_WATER | TMX::HORIZONTAL;
+	tileset.convertToTexture({flippedWater});
+	EXPECT_THROW(tileset.addAnimation(BLOCK_SAND, {30}, 0.5f), std::runtime_error);
+
+	sf::Vertex flipped[4], unflipped[4];
+	tileset.textureQuad(flipped, (BlockType) 30, 0, Tileset::getFrameFlipGID(flippedWater, 30));
+	tileset.textureQuad(unflipped, (BlockType) 30, 0, 0);
+	EXPECT_NE(flipped[0].texCoords, unflipped[0].texCoords);
+}